@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "lib.h"
 #include "allocate.h"
@@ -43,6 +44,37 @@
 #include "expression.h"
 #include "linearize.h"
 
+/*
+ * Every allocator of this thread that has handed out memory, so that
+ * the whole lot can be checkpointed and rolled back at once.
+ */
+static __thread struct allocator_struct *all_allocators;
+
+static __thread enum alloc_phase alloc_phase;
+
+static const char *alloc_phase_names[ALLOC_PHASES] = {
+	[ALLOC_PHASE_INIT] = "init",
+	[ALLOC_PHASE_TOKENIZE] = "tokenize",
+	[ALLOC_PHASE_PREPROCESS] = "preprocess",
+	[ALLOC_PHASE_PARSE] = "parse",
+	[ALLOC_PHASE_EVALUATE] = "evaluate",
+	[ALLOC_PHASE_EXPAND] = "expand",
+	[ALLOC_PHASE_LINEARIZE] = "linearize",
+};
+
+/*
+ * The phases nest (the preprocessor tokenizes include files,
+ * the evaluator expands constant expressions, ...), so this
+ * returns the old phase for the caller to restore.
+ */
+enum alloc_phase set_alloc_phase(enum alloc_phase phase)
+{
+	enum alloc_phase old = alloc_phase;
+
+	alloc_phase = phase;
+	return old;
+}
+
 void protect_allocations(struct allocator_struct *desc)
 {
 	desc->blobs = NULL;
@@ -57,6 +89,8 @@ void drop_all_allocations(struct allocator_struct *desc)
 	desc->total_bytes = 0;
 	desc->useful_bytes = 0;
 	desc->freelist = NULL;
+	memset(desc->sized_freelist, 0, sizeof(desc->sized_freelist));
+	desc->sized_free = 0;
 	while (blob) {
 		struct allocation_blob *next = blob->next;
 		blob_free(blob, desc->chunking);
@@ -64,6 +98,182 @@ void drop_all_allocations(struct allocator_struct *desc)
 	}
 }
 
+void mark_allocations(struct allocator_struct *desc, struct allocator_mark *mark)
+{
+	struct allocation_blob *blob = desc->blobs;
+
+	mark->blob = blob;
+	mark->left = blob ? blob->left : 0;
+	mark->offset = blob ? blob->offset : 0;
+	mark->allocations = desc->allocations;
+	mark->total_bytes = desc->total_bytes;
+	mark->useful_bytes = desc->useful_bytes;
+}
+
+/*
+ * Throw away everything allocated since the mark was taken.
+ * Marks nest: rolling back to an older one drops everything
+ * after any newer one too.
+ *
+ * The freelist is dropped too: entries on it may have been
+ * handed out again since the mark, so it can't be trusted.
+ */
+void rollback_allocations(struct allocator_struct *desc, struct allocator_mark *mark)
+{
+	struct allocation_blob *blob = desc->blobs;
+	struct allocation_blob *marked = mark->blob;
+
+	while (blob != marked) {
+		struct allocation_blob *next;
+
+		/* The marked blob got protected, it's not ours any more */
+		if (!blob) {
+			marked = NULL;
+			break;
+		}
+		next = blob->next;
+		blob_free(blob, desc->chunking);
+		blob = next;
+	}
+	desc->blobs = marked;
+	if (marked) {
+		/* Fresh allocations are expected to come back zeroed */
+		memset(marked->data + mark->offset, 0, marked->offset - mark->offset);
+		marked->left = mark->left;
+		marked->offset = mark->offset;
+	}
+	desc->freelist = NULL;
+	memset(desc->sized_freelist, 0, sizeof(desc->sized_freelist));
+	desc->sized_free = 0;
+	desc->allocations = mark->allocations;
+	desc->total_bytes = mark->total_bytes;
+	desc->useful_bytes = mark->useful_bytes;
+}
+
+void mark_all_allocations(void)
+{
+	struct allocator_struct *desc;
+
+	for (desc = all_allocators; desc; desc = desc->next)
+		mark_allocations(desc, &desc->mark);
+}
+
+static __thread struct allocator_struct ident_allocator;
+
+/*
+ * Identifiers are interned in the hash table and referenced
+ * by the streams, so they are kept for the whole run.
+ */
+void rollback_all_allocations(void)
+{
+	struct allocator_struct *desc;
+
+	for (desc = all_allocators; desc; desc = desc->next) {
+		if (desc == &ident_allocator)
+			continue;
+		rollback_allocations(desc, &desc->mark);
+	}
+}
+
+static void register_allocator(struct allocator_struct *desc)
+{
+	if (!desc->registered) {
+		desc->registered = 1;
+		desc->next = all_allocators;
+		all_allocators = desc;
+	}
+}
+
+struct allocator_handoff {
+	struct allocator_handoff *next;
+	struct allocator_struct *(*self)(void);
+	struct allocation_blob *blobs;
+	unsigned long long allocations, total_bytes, useful_bytes;
+	struct allocator_stats phase[ALLOC_PHASES];
+};
+
+/*
+ * Detach everything the calling thread has allocated, so that
+ * another thread can take it over with merge_allocations(). Our
+ * allocators start again from scratch, and any marks taken on
+ * them are gone. This is meant to be the last thing a worker
+ * thread does, so its cached blobs are released too.
+ */
+struct allocator_handoff *handoff_allocations(void)
+{
+	struct allocator_handoff *list = NULL;
+	struct allocator_struct *desc;
+
+	for (desc = all_allocators; desc; desc = desc->next) {
+		struct allocator_handoff *h;
+
+		if (!desc->blobs)
+			continue;
+		h = malloc(sizeof(*h));
+		if (!h)
+			die("out of memory");
+		h->self = desc->self;
+		h->blobs = desc->blobs;
+		h->allocations = desc->allocations;
+		h->total_bytes = desc->total_bytes;
+		h->useful_bytes = desc->useful_bytes;
+		memcpy(h->phase, desc->phase, sizeof(h->phase));
+		h->next = list;
+		list = h;
+
+		desc->blobs = NULL;
+		desc->allocations = 0;
+		desc->total_bytes = 0;
+		desc->useful_bytes = 0;
+		memset(desc->phase, 0, sizeof(desc->phase));
+		desc->freelist = NULL;
+		memset(desc->sized_freelist, 0, sizeof(desc->sized_freelist));
+		desc->sized_free = 0;
+		memset(&desc->mark, 0, sizeof(desc->mark));
+	}
+	blob_cache_flush();
+	return list;
+}
+
+/*
+ * Take over the blobs of another thread. They go in front of
+ * ours, as if we had just allocated them: rolling back to a mark
+ * taken before the merge frees them, and new allocations go into
+ * the other thread's last blob.
+ */
+void merge_allocations(struct allocator_handoff *handoff)
+{
+	while (handoff) {
+		struct allocator_handoff *next = handoff->next;
+		struct allocator_struct *desc = handoff->self();
+		struct allocation_blob *tail = handoff->blobs;
+		int i;
+
+		while (tail->next)
+			tail = tail->next;
+		tail->next = desc->blobs;
+		desc->blobs = handoff->blobs;
+		register_allocator(desc);
+
+		desc->allocations += handoff->allocations;
+		desc->total_bytes += handoff->total_bytes;
+		desc->useful_bytes += handoff->useful_bytes;
+		if (desc->total_bytes > desc->peak_bytes)
+			desc->peak_bytes = desc->total_bytes;
+		for (i = 0; i < ALLOC_PHASES; i++) {
+			struct allocator_stats *stats = &desc->phase[i];
+
+			stats->allocations += handoff->phase[i].allocations;
+			stats->useful_bytes += handoff->phase[i].useful_bytes;
+			stats->total_bytes += handoff->phase[i].total_bytes;
+			if (handoff->phase[i].peak_bytes > stats->peak_bytes)
+				stats->peak_bytes = handoff->phase[i].peak_bytes;
+		}
+		free(handoff);
+		handoff = next;
+	}
+}
+
 void free_one_entry(struct allocator_struct *desc, void *entry)
 {
 	void **p = entry;
@@ -71,10 +281,56 @@ void free_one_entry(struct allocator_struct *desc, void *entry)
 	desc->freelist = p;
 }
 
+static inline int size_class(unsigned int size)
+{
+	int class = 0;
+
+	while (size >>= 1)
+		class++;
+	return class;
+}
+
+/*
+ * Entries of a variable-sized allocator (strings, bytes, anything
+ * allocated with "extra") can be freed too, as long as the caller
+ * knows the size it asked for. The entries need not be pointer
+ * aligned, so the list links are copied in and out.
+ */
+void free_sized_entry(struct allocator_struct *desc, void *entry, unsigned int size)
+{
+	int class;
+
+	if (size < sizeof(void *))
+		return;
+	class = size_class(size);
+	if (class >= ALLOCATOR_SIZE_CLASSES)
+		return;
+	memcpy(entry, &desc->sized_freelist[class], sizeof(void *));
+	desc->sized_freelist[class] = entry;
+	desc->sized_free++;
+}
+
+static void *allocate_sized(struct allocator_struct *desc, unsigned int size)
+{
+	int class = size_class(size - 1) + 1;
+	void *entry;
+
+	if (class >= ALLOCATOR_SIZE_CLASSES)
+		return NULL;
+	entry = desc->sized_freelist[class];
+	if (entry) {
+		memcpy(&desc->sized_freelist[class], entry, sizeof(void *));
+		desc->sized_free--;
+		memset(entry, 0, size);
+	}
+	return entry;
+}
+
 void *allocate(struct allocator_struct *desc, unsigned int size)
 {
 	unsigned long alignment = desc->alignment;
 	struct allocation_blob *blob = desc->blobs;
+	struct allocator_stats *stats;
 	void *retval;
 
 	/*
@@ -94,7 +350,15 @@ void *allocate(struct allocator_struct *desc, unsigned int size)
 		} while ((size -= sizeof(void *)) > 0);
 		return retval;
 	}
+	if (desc->sized_free) {
+		retval = allocate_sized(desc, size);
+		if (retval)
+			return retval;
+	}
 
+	stats = &desc->phase[alloc_phase];
+	stats->allocations++;
+	stats->useful_bytes += size;
 	desc->allocations++;
 	desc->useful_bytes += size;
 	size = (size + alignment - 1) & ~(alignment-1);
@@ -103,7 +367,13 @@ void *allocate(struct allocator_struct *desc, unsigned int size)
 		struct allocation_blob *newblob = blob_alloc(chunking);
 		if (!newblob)
 			die("out of memory");
+		register_allocator(desc);
 		desc->total_bytes += chunking;
+		if (desc->total_bytes > desc->peak_bytes)
+			desc->peak_bytes = desc->total_bytes;
+		stats->total_bytes += chunking;
+		if (desc->total_bytes > stats->peak_bytes)
+			stats->peak_bytes = desc->total_bytes;
 		newblob->next = blob;
 		blob = newblob;
 		desc->blobs = newblob;
@@ -120,11 +390,82 @@ void *allocate(struct allocator_struct *desc, unsigned int size)
 
 void show_allocations(struct allocator_struct *x)
 {
-	fprintf(stderr, "%s: %d allocations, %d bytes (%d total bytes, "
-			"%6.2f%% usage, %6.2f average size)\n",
+	fprintf(stderr, "%s: %llu allocations, %llu bytes (%llu total bytes, "
+			"%6.2f%% usage, %6.2f average size, %llu peak bytes)\n",
 		x->name, x->allocations, x->useful_bytes, x->total_bytes,
 		100 * (double) x->useful_bytes / x->total_bytes,
-		(double) x->useful_bytes / x->allocations);
+		(double) x->useful_bytes / x->allocations,
+		x->peak_bytes);
+}
+
+/*
+ * What an allocator has handed out over the whole run. The live
+ * counters can't be used for that, they go back down whenever
+ * a file or a function is rolled back.
+ */
+static void lifetime_stats(struct allocator_struct *desc, struct allocator_stats *total)
+{
+	int i;
+
+	memset(total, 0, sizeof(*total));
+	for (i = 0; i < ALLOC_PHASES; i++) {
+		total->allocations += desc->phase[i].allocations;
+		total->useful_bytes += desc->phase[i].useful_bytes;
+		total->total_bytes += desc->phase[i].total_bytes;
+	}
+	total->peak_bytes = desc->peak_bytes;
+}
+
+void show_all_allocations(void)
+{
+	struct allocator_struct *desc;
+
+	for (desc = all_allocators; desc; desc = desc->next) {
+		struct allocator_stats total;
+
+		lifetime_stats(desc, &total);
+		fprintf(stderr, "%s: %llu allocations, %llu bytes (%llu total bytes, "
+				"%llu peak bytes)\n",
+			desc->name, total.allocations, total.useful_bytes,
+			total.total_bytes, total.peak_bytes);
+	}
+}
+
+static void show_stats_json(const char *indent, struct allocator_stats *stats, const char *sep)
+{
+	printf("%s\"allocations\": %llu,\n", indent, stats->allocations);
+	printf("%s\"useful_bytes\": %llu,\n", indent, stats->useful_bytes);
+	printf("%s\"total_bytes\": %llu,\n", indent, stats->total_bytes);
+	printf("%s\"peak_bytes\": %llu%s\n", indent, stats->peak_bytes, sep);
+}
+
+/*
+ * The same as show_all_allocations(), but on stdout and in a
+ * form that's meant for scripts, with what each phase allocated
+ * and the high-water mark the allocator reached while it ran.
+ */
+void show_all_allocations_json(void)
+{
+	struct allocator_struct *desc;
+
+	printf("{\n  \"allocators\": [");
+	for (desc = all_allocators; desc; desc = desc->next) {
+		struct allocator_stats total;
+		int i;
+
+		lifetime_stats(desc, &total);
+		printf("%s\n    {\n", desc == all_allocators ? "" : ",");
+		printf("      \"name\": \"%s\",\n", desc->name);
+		show_stats_json("      ", &total, ",");
+		printf("      \"phases\": {");
+		for (i = 0; i < ALLOC_PHASES; i++) {
+			printf("%s\n        \"%s\": {\n", i ? "," : "", alloc_phase_names[i]);
+			show_stats_json("          ", &desc->phase[i], "");
+			printf("        }");
+		}
+		printf("\n      }\n    }");
+	}
+	printf("\n  ]\n}\n");
 }
 
 ALLOCATOR(ident, "identifiers");
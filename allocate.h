@@ -7,35 +7,107 @@ struct allocation_blob {
 	unsigned char data[];
 };
 
+/*
+ * A checkpoint of an allocator: the blob that was current
+ * when the mark was taken and how far into it we had got.
+ */
+struct allocator_mark {
+	struct allocation_blob *blob;
+	unsigned int left, offset;
+	unsigned long long allocations, total_bytes, useful_bytes;
+};
+
+/*
+ * Allocations are charged to the phase that is running when
+ * they are made, see set_alloc_phase().
+ */
+enum alloc_phase {
+	ALLOC_PHASE_INIT,
+	ALLOC_PHASE_TOKENIZE,
+	ALLOC_PHASE_PREPROCESS,
+	ALLOC_PHASE_PARSE,
+	ALLOC_PHASE_EVALUATE,
+	ALLOC_PHASE_EXPAND,
+	ALLOC_PHASE_LINEARIZE,
+	ALLOC_PHASES
+};
+
+struct allocator_stats {
+	unsigned long long allocations, useful_bytes, total_bytes;
+	/* high-water mark of the allocator's blob bytes */
+	unsigned long long peak_bytes;
+};
+
+/*
+ * Variable-sized entries are freed onto one list per power-of-two
+ * size class: list 'n' holds entries of at least (1 << n) bytes.
+ */
+#define ALLOCATOR_SIZE_CLASSES 16
+
 struct allocator_struct {
 	const char *name;
 	struct allocation_blob *blobs;
 	unsigned int alignment;
 	unsigned int chunking;
 	void *freelist;
+	void *sized_freelist[ALLOCATOR_SIZE_CLASSES];
+	unsigned int sized_free;
 	/* statistics */
-	unsigned int allocations, total_bytes, useful_bytes;
+	unsigned long long allocations, total_bytes, useful_bytes;
+	unsigned long long peak_bytes;
+	struct allocator_stats phase[ALLOC_PHASES];
+	/* checkpoint, see mark_all_allocations() */
+	struct allocator_mark mark;
+	struct allocator_struct *next;
+	int registered;
+	/* the calling thread's instance of this allocator */
+	struct allocator_struct *(*self)(void);
 };
 
+/*
+ * Allocators are per thread. What a thread allocated can be
+ * handed to another one, see handoff_allocations().
+ */
+struct allocator_handoff;
+
 extern void protect_allocations(struct allocator_struct *desc);
 extern void drop_all_allocations(struct allocator_struct *desc);
+extern void mark_allocations(struct allocator_struct *desc, struct allocator_mark *mark);
+extern void rollback_allocations(struct allocator_struct *desc, struct allocator_mark *mark);
+extern void mark_all_allocations(void);
+extern void rollback_all_allocations(void);
 extern void *allocate(struct allocator_struct *desc, unsigned int size);
 extern void free_one_entry(struct allocator_struct *desc, void *entry);
+extern void free_sized_entry(struct allocator_struct *desc, void *entry, unsigned int size);
 extern void show_allocations(struct allocator_struct *);
+extern enum alloc_phase set_alloc_phase(enum alloc_phase phase);
+extern void show_all_allocations(void);
+extern void show_all_allocations_json(void);
+extern struct allocator_handoff *handoff_allocations(void);
+extern void merge_allocations(struct allocator_handoff *handoff);
 
-#define __DECLARE_ALLOCATOR(type, x)		\
-	extern type *__alloc_##x(int);		\
-	extern void __free_##x(type *);		\
-	extern void show_##x##_alloc(void);	\
-	extern void clear_##x##_alloc(void);	\
-	extern void protect_##x##_alloc(void);
+#define __DECLARE_ALLOCATOR(type, x)				\
+	extern type *__alloc_##x(int);				\
+	extern void __free_##x(type *);				\
+	extern void __free_sized_##x(type *, int);		\
+	extern void show_##x##_alloc(void);			\
+	extern void clear_##x##_alloc(void);			\
+	extern void protect_##x##_alloc(void);			\
+	extern void mark_##x##_alloc(struct allocator_mark *);	\
+	extern void rollback_##x##_alloc(struct allocator_mark *);
 #define DECLARE_ALLOCATOR(x) __DECLARE_ALLOCATOR(struct x, x)
 
 #define __DO_ALLOCATOR(type, objsize, objalign, objname, x)	\
-	static struct allocator_struct x##_allocator = {	\
+	static struct allocator_struct *x##_allocator_self(void);	\
+	static __thread struct allocator_struct x##_allocator = {	\
 		.name = objname,				\
 		.alignment = objalign,				\
-		.chunking = CHUNK };				\
+		.chunking = CHUNK,				\
+		.self = x##_allocator_self };			\
+	static struct allocator_struct *x##_allocator_self(void)	\
+	{							\
+		return &x##_allocator;				\
+	}							\
 	type *__alloc_##x(int extra)				\
 	{							\
 		return allocate(&x##_allocator, objsize+extra);	\
@@ -44,6 +116,10 @@ extern void show_allocations(struct allocator_struct *);
 	{							\
 		free_one_entry(&x##_allocator, entry);		\
 	}							\
+	void __free_sized_##x(type *entry, int extra)		\
+	{							\
+		free_sized_entry(&x##_allocator, entry, objsize+extra);	\
+	}							\
 	void show_##x##_alloc(void)				\
 	{							\
 		show_allocations(&x##_allocator);		\
@@ -55,6 +131,14 @@ extern void show_allocations(struct allocator_struct *);
 	void protect_##x##_alloc(void)				\
 	{							\
 		protect_allocations(&x##_allocator);		\
+	}							\
+	void mark_##x##_alloc(struct allocator_mark *mark)	\
+	{							\
+		mark_allocations(&x##_allocator, mark);		\
+	}							\
+	void rollback_##x##_alloc(struct allocator_mark *mark)	\
+	{							\
+		rollback_allocations(&x##_allocator, mark);	\
 	}
 
 #define __ALLOCATOR(t, n, x) 					\
@@ -71,6 +155,7 @@ DECLARE_ALLOCATOR(statement);
 DECLARE_ALLOCATOR(string);
 DECLARE_ALLOCATOR(scope);
 __DECLARE_ALLOCATOR(void, bytes);
+__DECLARE_ALLOCATOR(struct ptr_list, ptrlist);
 DECLARE_ALLOCATOR(basic_block);
 DECLARE_ALLOCATOR(entrypoint);
 DECLARE_ALLOCATOR(instruction);
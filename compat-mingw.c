@@ -33,6 +33,10 @@
 #include "allocate.h"
 #include "token.h"
 	
+/* Blobs are not cached here, the settings are ignored */
+unsigned long blob_cache_size;
+int blob_huge_blobs;
+	
 void *blob_alloc(unsigned long size)	
 {	
 	void *ptr;	
@@ -47,6 +51,20 @@ void blob_free(void *addr, unsigned long size)
 	free(addr);	
 }	
 	
+void blob_cache_flush(void)	
+{	
+}	
+	
+/* Files are always read() here */
+void *map_file(int fd, unsigned long size)
+{
+	return NULL;
+}
+
+void unmap_file(void *addr, unsigned long size)
+{
+}
+	
 long double string_to_ld(const char *nptr, char **endptr) 	
 {	
 	return strtod(nptr, endptr);	
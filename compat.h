@@ -9,6 +9,8 @@
  *	Missing in MinGW
  *  - "string to long double" (C99 strtold())
  *	Missing in Solaris and MinGW
+ *  - mapping a file to read it
+ *	Missing in MinGW
  */
 struct stream;
 struct stat;
@@ -23,6 +25,17 @@ struct stat;
 
 void *blob_alloc(unsigned long size);
 void blob_free(void *addr, unsigned long size);
+void blob_cache_flush(void);
+extern unsigned long blob_cache_size;
+extern int blob_huge_blobs;
 long double string_to_ld(const char *nptr, char **endptr);
 
+/*
+ * Map "size" bytes of a file read-only, with at least one NUL byte
+ * after them. NULL if that can't be done: the file then has to be
+ * read() instead.
+ */
+void *map_file(int fd, unsigned long size);
+void unmap_file(void *addr, unsigned long size);
+
 #endif
@@ -1,5 +1,7 @@
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <string.h>
+#include <unistd.h>
 
 /*
  * Allow old BSD naming too, it would be a pity to have to make a
@@ -9,6 +11,68 @@
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
+/*
+ * Freed blobs are kept on a cache (up to blob_cache_size bytes of
+ * them) and handed out again, rather than going back and forth to
+ * the kernel for every chunk when the allocators get rolled back.
+ *
+ * With blob_huge_blobs set, the cache is refilled a whole
+ * SUPER_CHUNK at a time, in the hope of getting huge pages.
+ *
+ * The cache is per thread, like the allocators that use it, but
+ * blob_cache_size is a limit on all the threads' caches together.
+ */
+#define SUPER_CHUNK (64 * CHUNK)
+
+unsigned long blob_cache_size = 64UL << 20;
+int blob_huge_blobs = 0;
+
+static __thread void *blob_cache;
+static __thread unsigned long blob_cache_bytes;
+static unsigned long blob_cache_total;
+
+static void *map_blob(unsigned long size)
+{
+	void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+		ptr = NULL;
+	return ptr;
+}
+
+/* The caller has already counted the blob in blob_cache_total */
+static void cache_blob(void *addr, unsigned long size)
+{
+	*(void **)addr = blob_cache;
+	blob_cache = addr;
+	blob_cache_bytes += size;
+}
+
+/*
+ * A huge page has to be aligned on its size, and mmap only aligns
+ * on a page: so map twice as much and keep the aligned middle.
+ */
+static void refill_blob_cache(void)
+{
+	unsigned char *area = map_blob(2 * SUPER_CHUNK), *super;
+	unsigned long head, tail, offset;
+
+	if (!area)
+		return;
+	super = (unsigned char *)(((unsigned long) area + SUPER_CHUNK - 1) & ~(SUPER_CHUNK - 1));
+	head = super - area;
+	tail = SUPER_CHUNK - head;
+	if (head)
+		munmap(area, head);
+	if (tail)
+		munmap(super + SUPER_CHUNK, tail);
+	__sync_fetch_and_add(&blob_cache_total, SUPER_CHUNK);
+#ifdef MADV_HUGEPAGE
+	madvise(super, SUPER_CHUNK, MADV_HUGEPAGE);
+#endif
+	for (offset = SUPER_CHUNK; offset; offset -= CHUNK)
+		cache_blob(super + offset - CHUNK, CHUNK);
+}
+
 /*
  * Our blob allocator enforces the strict CHUNK size
  * requirement, as a portability check.
@@ -19,17 +83,80 @@ void *blob_alloc(unsigned long size)
 
 	if (size & ~CHUNK)
 		die("internal error: bad allocation size (%lu bytes)", size);
-	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-	if (ptr == MAP_FAILED)
-		ptr = NULL;
+	if (!blob_cache && blob_huge_blobs)
+		refill_blob_cache();
+	if (blob_cache) {
+		/* Blobs are expected to come back zeroed, like from mmap */
+		ptr = blob_cache;
+		blob_cache = *(void **)ptr;
+		blob_cache_bytes -= size;
+		__sync_fetch_and_sub(&blob_cache_total, size);
+		memset(ptr, 0, size);
+		return ptr;
+	}
+	return map_blob(size);
+}
+
+/*
+ * Give this thread's cached blobs back to the system, for
+ * threads that are about to exit.
+ */
+void blob_cache_flush(void)
+{
+	while (blob_cache) {
+		void *next = *(void **)blob_cache;
+		munmap(blob_cache, CHUNK);
+		blob_cache = next;
+	}
+	__sync_fetch_and_sub(&blob_cache_total, blob_cache_bytes);
+	blob_cache_bytes = 0;
+}
+
+static unsigned long mapped_size(unsigned long size)
+{
+	unsigned long page = sysconf(_SC_PAGESIZE);
+
+	/* Room for the NUL */
+	return (size + page) & ~(page - 1);
+}
+
+/*
+ * The bytes after the end of the file in its last page are zeroes,
+ * but that page could be full: so reserve an anonymous (so zeroed)
+ * area one byte bigger than the file first, and map the file over
+ * its beginning.
+ */
+void *map_file(int fd, unsigned long size)
+{
+	unsigned long len = mapped_size(size);
+	void *area, *ptr;
+
+	area = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		return NULL;
+	ptr = mmap(area, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+	if (ptr == MAP_FAILED) {
+		munmap(area, len);
+		return NULL;
+	}
 	return ptr;
 }
 
+void unmap_file(void *addr, unsigned long size)
+{
+	munmap(addr, mapped_size(size));
+}
+
 void blob_free(void *addr, unsigned long size)
 {
 	if (!size || (size & ~CHUNK) || ((unsigned long) addr & 512))
 		die("internal error: bad blob free (%lu bytes at %p)", size, addr);
 #ifndef DEBUG
+	if (__sync_add_and_fetch(&blob_cache_total, size) <= blob_cache_size) {
+		cache_blob(addr, size);
+		return;
+	}
+	__sync_fetch_and_sub(&blob_cache_total, size);
 	munmap(addr, size);
 #else
 	mprotect(addr, size, PROT_NONE);
@@ -56,6 +56,7 @@
 #include "expression.h"
 #include "target.h"
 #include "compile.h"
+#include "linearize.h"
 #include "bitmap.h"
 
 struct textbuf {
@@ -157,6 +158,7 @@ enum atom_type {
 	ATOM_TEXT,
 	ATOM_INSN,
 	ATOM_CSTR,
+	ATOM_DATA,
 };
 
 struct atom {
@@ -181,6 +183,13 @@ struct atom {
 			struct string *string;
 			int label;
 		};
+
+		/* stuff for read-only data */
+		struct {
+			unsigned char *data;
+			unsigned int data_size;
+			int data_label;
+		};
 	};
 };
 
@@ -491,6 +500,19 @@ static inline void push_cstring(struct function *f, struct string *str,
 	add_ptr_list(&f->str_list, atom);	/* note: _not_ atom_list */
 }
 
+static inline void push_data(struct function *f, unsigned char *data,
+			     unsigned int size, int label)
+{
+	struct atom *atom;
+
+	atom = new_atom(ATOM_DATA);
+	atom->data = data;
+	atom->data_size = size;
+	atom->data_label = label;
+
+	add_ptr_list(&f->str_list, atom);	/* note: _not_ atom_list */
+}
+
 static inline void push_atom(struct function *f, struct atom *atom)
 {
 	add_ptr_list(&f->atom_list, atom);
@@ -751,6 +773,7 @@ static void emit_atom_list(struct function *f)
 			emit_insn_atom(f, atom);
 			break;
 		case ATOM_CSTR:
+		case ATOM_DATA:
 			assert(0);
 			break;
 		}
@@ -764,6 +787,14 @@ static void emit_string_list(struct function *f)
 	emit_section(".section\t.rodata");
 
 	FOR_EACH_PTR(f->str_list, atom) {
+		if (atom->type == ATOM_DATA) {
+			printf(".L%d:\n", atom->data_label);
+			show_initializer_bytes(atom->data, atom->data_size);
+			free(atom->data);
+			free(atom);
+			continue;
+		}
+
 		/* FIXME: escape " in string */
 		printf(".L%d:\n", atom->label);
 		printf("\t.string\t%s\n", show_string(atom->string));
@@ -2245,13 +2276,40 @@ static struct storage *x86_symbol_expr(struct symbol *sym)
 	return new;
 }
 
+/*
+ * A big constant aggregate is copied from read-only data, instead
+ * of being built up one member at a time.
+ */
+static struct storage *x86_bulk_init(struct symbol *sym)
+{
+	unsigned int size = sym->bit_size / 8;
+	unsigned char *data = malloc(size);
+	struct storage *new, *src;
+	char opname[16];
+
+	if (!data)
+		die("OOM in x86_bulk_init");
+	initializer_bytes(sym->initializer, data, size);
+	src = new_storage(STOR_LABEL);
+	src->label = new_label();
+	src->flags = STOR_WANTS_FREE;
+	push_data(current_func, data, size, src->label);
+
+	new = stack_alloc(size);
+	sprintf(opname, "copy.%u", size * 8);
+	insn(opname, src, new, "bulk initializer");
+	return new;
+}
+
 static void x86_symbol_init(struct symbol *sym)
 {
 	struct symbol_private *priv = sym->aux;
 	struct expression *expr = sym->initializer;
 	struct storage *new;
 
-	if (expr)
+	if (expr && bulk_initializer(sym))
+		new = x86_bulk_init(sym);
+	else if (expr)
 		new = x86_expression(expr);
 	else
 		new = stack_alloc(sym->bit_size / 8);
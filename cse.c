@@ -17,8 +17,18 @@
 #include "linearize.h"
 #include "flow.h"
 
-#define INSN_HASH_SIZE 256
-static struct instruction_list *insn_hash_table[INSN_HASH_SIZE];
+/*
+ * The value table: every instruction we may CSE, seen so far in this
+ * pass, open addressed on its hash. It only ever grows, and is
+ * emptied (not freed) at the start of each pass.
+ */
+struct value_entry {
+	unsigned long hash;
+	struct instruction *insn;
+};
+
+static struct value_entry *value_table;
+static unsigned long value_table_size, value_table_nr;
 
 int repeat_phase;
 
@@ -35,14 +45,14 @@ static int phi_compare(pseudo_t phi1, pseudo_t phi2)
 }
 
 
-static void clean_up_one_instruction(struct basic_block *bb, struct instruction *insn)
+/*
+ * The hash of what the instruction computes, or 0 if it isn't
+ * something we try to CSE.
+ */
+static unsigned long insn_hash(struct instruction *insn)
 {
 	unsigned long hash;
 
-	if (!insn->bb)
-		return;
-	assert(insn->bb == bb);
-	repeat_phase |= simplify_instruction(insn);
 	hash = (insn->opcode << 3) + (insn->size >> 3);
 	switch (insn->opcode) {
 	case OP_SEL:
@@ -116,23 +126,14 @@ static void clean_up_one_instruction(struct basic_block *bb, struct instruction
 		 * Nothing to do, don't even bother hashing them,
 		 * we're not going to try to CSE them
 		 */
-		return;
+		return 0;
 	}
-	hash += hash >> 16;
-	hash &= INSN_HASH_SIZE-1;
-	add_instruction(insn_hash_table + hash, insn);
-}
-
-static void clean_up_insns(struct entrypoint *ep)
-{
-	struct basic_block *bb;
 
-	FOR_EACH_PTR(ep->bbs, bb) {
-		struct instruction *insn;
-		FOR_EACH_PTR(bb->insns, insn) {
-			clean_up_one_instruction(bb, insn);
-		} END_FOR_EACH_PTR(insn);
-	} END_FOR_EACH_PTR(bb);
+	/* The pseudos are pointers: spread their bits over the table */
+	hash ^= hash >> 31;
+	hash *= 0x9e3779b97f4a7c15ULL;
+	hash ^= hash >> 29;
+	return hash | 1;
 }
 
 /* Compare two (sorted) phi-lists */
@@ -242,55 +243,25 @@ static int insn_compare(const void *_i1, const void *_i2)
 	return 0;
 }
 
-static void sort_instruction_list(struct instruction_list **list)
-{
-	sort_list((struct ptr_list **)list , insn_compare);
-}
-
 static struct instruction * cse_one_instruction(struct instruction *insn, struct instruction *def)
 {
 	convert_instruction_target(insn, def->target);
 
 	if (insn->opcode == OP_PHI) {
 		/* Remove the instruction from PHI users */
-		pseudo_t phi;
-		FOR_EACH_PTR(insn->phi_list, phi) {
-			struct pseudo_user *pu;
-			FOR_EACH_PTR(phi->users, pu) {
-				if (pu->insn == insn)
-					DELETE_CURRENT_PTR(pu);
-			} END_FOR_EACH_PTR(pu);
-		} END_FOR_EACH_PTR(phi);
+		struct pseudo_user *pu;
+		for (pu = insn->uses; pu; pu = pu->next_use) {
+			if (pu->pseudo)
+				unlink_pseudo_user(pu);
+		}
+		insn->uses = NULL;
 	}
 
 	insn->opcode = OP_NOP;
 	insn->bb = NULL;
-	repeat_phase |= REPEAT_CSE;
 	return def;
 }
 
-/*
- * Does "bb1" dominate "bb2"?
- */
-static int bb_dominates(struct entrypoint *ep, struct basic_block *bb1, struct basic_block *bb2, unsigned long generation)
-{
-	struct basic_block *parent;
-
-	/* Nothing dominates the entrypoint.. */
-	if (bb2 == ep->entry->bb)
-		return 0;
-	FOR_EACH_PTR(bb2->parents, parent) {
-		if (parent == bb1)
-			continue;
-		if (parent->generation == generation)
-			continue;
-		parent->generation = generation;
-		if (!bb_dominates(ep, bb1, parent, generation))
-			return 0;
-	} END_FOR_EACH_PTR(parent);
-	return 1;
-}
-
 static struct basic_block *trivial_common_parent(struct basic_block *bb1, struct basic_block *bb2)
 {
 	struct basic_block *parent;
@@ -318,80 +289,156 @@ static void add_instruction_to_end(struct instruction *insn, struct basic_block
 	add_instruction(&bb->insns, br);
 }
 
-static struct instruction * try_to_cse(struct entrypoint *ep, struct instruction *i1, struct instruction *i2)
+/*
+ * "insn" in "bb" computes the same as "def", from earlier in the
+ * walk. The users of "insn" all come later in the walk, so they
+ * see the replacement in this same pass: only the phi-nodes it
+ * feeds (through a phisrc) may have been looked at already.
+ */
+static int try_to_cse(struct instruction *def, struct instruction *insn)
 {
-	struct basic_block *b1, *b2, *common;
-
-	/*
-	 * OK, i1 and i2 are the same instruction, modulo "target".
-	 * We should now see if we can combine them.
-	 */
-	b1 = i1->bb;
-	b2 = i2->bb;
-
-	/*
-	 * Currently we only handle the uninteresting degenerate case where
-	 * the CSE is inside one basic-block.
-	 */
-	if (b1 == b2) {
-		struct instruction *insn;
-		FOR_EACH_PTR(b1->insns, insn) {
-			if (insn == i1)
-				return cse_one_instruction(i2, i1);
-			if (insn == i2)
-				return cse_one_instruction(i1, i2);
-		} END_FOR_EACH_PTR(insn);
-		warning(b1->pos, "Whaa? unable to find CSE instructions");
-		return i1;
+	struct basic_block *b1 = def->bb, *b2 = insn->bb, *common;
+	struct pseudo_user *pu;
+
+	if (b1 != b2 && !bb_dominates(b1, b2)) {
+		/* No dominance - but we could try to find a common ancestor.. */
+		common = trivial_common_parent(b1, b2);
+		if (!common)
+			return 0;
+		cse_one_instruction(insn, def);
+		remove_instruction(&b1->insns, def, 1);
+		add_instruction_to_end(def, common);
+		repeat_phase |= REPEAT_CSE;
+		return 1;
 	}
-	if (bb_dominates(ep, b1, b2, ++bb_generation))
-		return cse_one_instruction(i2, i1);
-
-	if (bb_dominates(ep, b2, b1, ++bb_generation))
-		return cse_one_instruction(i1, i2);
-
-	/* No direct dominance - but we could try to find a common ancestor.. */
-	common = trivial_common_parent(b1, b2);
-	if (common) {
-		i1 = cse_one_instruction(i2, i1);
-		remove_instruction(&b1->insns, i1, 1);
-		add_instruction_to_end(i1, common);
+
+	FOR_EACH_USER(insn->target, pu) {
+		if (pu->insn->opcode == OP_PHISOURCE)
+			repeat_phase |= REPEAT_CSE;
+	} END_FOR_EACH_USER(pu);
+	cse_one_instruction(insn, def);
+	return 1;
+}
+
+static void grow_value_table(void)
+{
+	struct value_entry *old = value_table;
+	unsigned long i, old_size = value_table_size;
+
+	value_table_size = old_size ? old_size * 2 : 256;
+	value_table = calloc(value_table_size, sizeof(*value_table));
+	if (!value_table)
+		die("out of memory");
+	for (i = 0; i < old_size; i++) {
+		unsigned long n = old[i].hash;
+
+		if (!n)
+			continue;
+		for (;;) {
+			n &= value_table_size - 1;
+			if (!value_table[n].hash)
+				break;
+			n++;
+		}
+		value_table[n] = old[i];
 	}
+	free(old);
+}
 
-	return i1;
+/*
+ * Look "insn" up among the values computed so far, and either CSE it
+ * with one of them or add it as a new one.
+ */
+static void number_value(struct instruction *insn)
+{
+	unsigned long hash = insn_hash(insn), n;
+	struct value_entry *entry;
+
+	if (!hash)
+		return;
+	if (2 * (value_table_nr + 1) > value_table_size)
+		grow_value_table();
+
+	for (n = hash; ; n++) {
+		struct instruction *def;
+
+		entry = value_table + (n & (value_table_size - 1));
+		if (!entry->hash)
+			break;
+		def = entry->insn;
+		if (entry->hash != hash || !def->bb)
+			continue;
+		if (insn_compare(def, insn))
+			continue;
+		if (try_to_cse(def, insn))
+			return;
+	}
+	entry->hash = hash;
+	entry->insn = insn;
+	value_table_nr++;
 }
 
+static void clean_up_one_instruction(struct basic_block *bb, struct instruction *insn, int number)
+{
+	if (!insn->bb)
+		return;
+	assert(insn->bb == bb);
+	repeat_phase |= simplify_instruction(insn);
+	if (number && insn->bb)
+		number_value(insn);
+}
+
+static void clean_up_insns(struct basic_block *bb, int number)
+{
+	struct instruction *insn;
+
+	FOR_EACH_PTR(bb->insns, insn) {
+		clean_up_one_instruction(bb, insn, number);
+	} END_FOR_EACH_PTR(insn);
+}
+
+/*
+ * Value numbering over the dominator tree: going down it, in one
+ * pass, each instruction is simplified and then looked up among
+ * the ones computed in its dominators (or earlier in its own bb).
+ * The bbs the tree doesn't reach are only simplified.
+ */
 void cleanup_and_cse(struct entrypoint *ep)
 {
-	int i;
+	struct basic_block **stack, *bb;
+	int top;
 
 	simplify_memops(ep);
 repeat:
 	repeat_phase = 0;
-	clean_up_insns(ep);
-	for (i = 0; i < INSN_HASH_SIZE; i++) {
-		struct instruction_list **list = insn_hash_table + i;
-		if (*list) {
-			if (instruction_list_size(*list) > 1) {
-				struct instruction *insn, *last;
-
-				sort_instruction_list(list);
-
-				last = NULL;
-				FOR_EACH_PTR(*list, insn) {
-					if (!insn->bb)
-						continue;
-					if (last) {
-						if (!insn_compare(last, insn))
-							insn = try_to_cse(ep, last, insn);
-					}
-					last = insn;
-				} END_FOR_EACH_PTR(insn);
-			}
-			free_ptr_list((struct ptr_list **)list);
-		}
+	if (!ep->dom_valid)
+		build_dom_tree(ep);
+	if (value_table_nr) {
+		memset(value_table, 0, value_table_size * sizeof(*value_table));
+		value_table_nr = 0;
 	}
 
+	stack = calloc(bb_list_size(ep->bbs), sizeof(*stack));
+	if (!stack)
+		die("out of memory");
+	top = 0;
+	stack[top++] = ep->entry->bb;
+	while (top) {
+		struct basic_block *child;
+
+		bb = stack[--top];
+		clean_up_insns(bb, 1);
+		FOR_EACH_PTR_REVERSE(bb->doms, child) {
+			stack[top++] = child;
+		} END_FOR_EACH_PTR_REVERSE(child);
+	}
+	free(stack);
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		if (!bb->dom_pre)
+			clean_up_insns(bb, 0);
+	} END_FOR_EACH_PTR(bb);
+
 	if (repeat_phase & REPEAT_SYMBOL_CLEANUP)
 		simplify_memops(ep);
 
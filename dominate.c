@@ -0,0 +1,192 @@
+/*
+ * Dominate - the dominator tree and dominance frontiers of an
+ * entrypoint's flowgraph.
+ *
+ * The tree is built with the Cooper, Harvey & Kennedy algorithm
+ * ("A Simple, Fast Dominance Algorithm") and numbered depth first,
+ * so that asking whether one bb dominates another is just a
+ * comparison of the numbers. It stays around until the flowgraph
+ * changes (see cfg_changed()).
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "parse.h"
+#include "expression.h"
+#include "linearize.h"
+#include "flow.h"
+
+static void *alloc_dom(int nr, int size)
+{
+	void *ptr = calloc(nr, size);
+
+	if (!ptr)
+		die("out of memory");
+	return ptr;
+}
+
+/*
+ * The bbs reachable from the entry, in reverse postorder. Each one
+ * gets its postorder number (from 1: 0 means it isn't reachable).
+ * Children not on ep->bbs (which a goto to an undeclared label can
+ * leave behind) are not followed.
+ */
+static int reverse_postorder(struct entrypoint *ep, struct basic_block **order, int nr, int edges)
+{
+	struct basic_block **stack = alloc_dom(2 * nr + edges, sizeof(*stack));
+	unsigned long in_ep = bb_generation, generation = ++bb_generation;
+	struct basic_block *bb;
+	int top = 0, n = 0;
+
+	stack[top++] = ep->entry->bb;
+	while (top) {
+		struct basic_block *child;
+
+		bb = stack[--top];
+		if ((unsigned long)bb & 1) {
+			bb = (void *)((unsigned long)bb & ~1UL);
+			bb->postorder_nr = ++n;
+			order[nr - n] = bb;
+			continue;
+		}
+		if (bb->generation == generation)
+			continue;
+		bb->generation = generation;
+		stack[top++] = (void *)((unsigned long)bb | 1);
+		FOR_EACH_PTR_REVERSE(bb->children, child) {
+			if (child->generation == in_ep)
+				stack[top++] = child;
+		} END_FOR_EACH_PTR_REVERSE(child);
+	}
+	free(stack);
+	return n;
+}
+
+static struct basic_block *intersect(struct basic_block *b1, struct basic_block *b2)
+{
+	while (b1 != b2) {
+		while (b1->postorder_nr < b2->postorder_nr)
+			b1 = b1->idom;
+		while (b2->postorder_nr < b1->postorder_nr)
+			b2 = b2->idom;
+	}
+	return b1;
+}
+
+/*
+ * Number the tree depth first: "a" dominates "b" exactly when b's
+ * numbers nest within a's.
+ */
+static void number_dom_tree(struct basic_block *entry, int nr)
+{
+	struct basic_block **stack = alloc_dom(2 * nr, sizeof(*stack));
+	unsigned int count = 0;
+	int top = 0;
+
+	entry->dom_level = 0;
+	stack[top++] = entry;
+	while (top) {
+		struct basic_block *bb = stack[--top], *child;
+
+		if ((unsigned long)bb & 1) {
+			bb = (void *)((unsigned long)bb & ~1UL);
+			bb->dom_post = ++count;
+			continue;
+		}
+		bb->dom_pre = ++count;
+		stack[top++] = (void *)((unsigned long)bb | 1);
+		FOR_EACH_PTR(bb->doms, child) {
+			child->dom_level = bb->dom_level + 1;
+			stack[top++] = child;
+		} END_FOR_EACH_PTR(child);
+	}
+	free(stack);
+}
+
+void build_dom_tree(struct entrypoint *ep)
+{
+	struct basic_block **order, *bb;
+	unsigned long in_ep = ++bb_generation;
+	int nr = 0, edges = 0, n, i, changed;
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		bb->generation = in_ep;
+		bb->idom = NULL;
+		free_ptr_list(&bb->doms);
+		free_ptr_list(&bb->df);
+		bb->postorder_nr = 0;
+		bb->dom_pre = bb->dom_post = 0;
+		edges += bb_list_size(bb->children);
+		nr++;
+	} END_FOR_EACH_PTR(bb);
+
+	order = alloc_dom(nr, sizeof(*order));
+	n = reverse_postorder(ep, order, nr, edges);
+	order += nr - n;
+
+	/* The entry is the first one in reverse postorder */
+	bb = order[0];
+	bb->idom = bb;
+	do {
+		changed = 0;
+		for (i = 1; i < n; i++) {
+			struct basic_block *parent, *idom = NULL;
+
+			bb = order[i];
+			FOR_EACH_PTR(bb->parents, parent) {
+				if (!parent->idom)
+					continue;
+				idom = idom ? intersect(parent, idom) : parent;
+			} END_FOR_EACH_PTR(parent);
+			if (idom != bb->idom) {
+				bb->idom = idom;
+				changed = 1;
+			}
+		}
+	} while (changed);
+
+	bb = order[0];
+	bb->idom = NULL;
+	for (i = 1; i < n; i++)
+		add_bb(&order[i]->idom->doms, order[i]);
+	number_dom_tree(bb, n);
+	free(order - (nr - n));
+
+	ep->dom_valid = 1;
+	ep->df_valid = 0;
+}
+
+/*
+ * The dominance frontier of a bb: where its dominance stops. These
+ * are only needed for placing phi-nodes, so they are computed on
+ * demand, from the tree.
+ */
+void build_dom_frontiers(struct entrypoint *ep)
+{
+	struct basic_block *bb;
+
+	if (!ep->dom_valid)
+		build_dom_tree(ep);
+	if (ep->df_valid)
+		return;
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct basic_block *parent;
+
+		if (!bb->dom_pre || bb_list_size(bb->parents) < 2)
+			continue;
+		FOR_EACH_PTR(bb->parents, parent) {
+			struct basic_block *runner = parent;
+
+			if (!runner->dom_pre)
+				continue;
+			while (runner != bb->idom) {
+				if (last_basic_block(runner->df) != bb)
+					add_bb(&runner->df, bb);
+				runner = runner->idom;
+			}
+		} END_FOR_EACH_PTR(parent);
+	} END_FOR_EACH_PTR(bb);
+	ep->df_valid = 1;
+}
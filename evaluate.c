@@ -3112,12 +3112,14 @@ static struct symbol *evaluate_symbol(struct symbol *sym)
 
 void evaluate_symbol_list(struct symbol_list *list)
 {
+	enum alloc_phase phase = set_alloc_phase(ALLOC_PHASE_EVALUATE);
 	struct symbol *sym;
 
 	FOR_EACH_PTR(list, sym) {
 		evaluate_symbol(sym);
 		check_duplicates(sym);
 	} END_FOR_EACH_PTR(sym);
+	set_alloc_phase(phase);
 }
 
 static struct symbol *evaluate_return_expression(struct statement *stmt)
@@ -73,6 +73,7 @@ static const char *opcodes[] = {
 	[OP_ALLOCA] = "alloca",
 	[OP_LOAD] = "load",
 	[OP_STORE] = "store",
+	[OP_INIT] = "init",
 	[OP_SETVAL] = "set",
 	[OP_GET_ELEMENT_PTR] = "getelem",
 
@@ -996,6 +997,37 @@ static void generate_load(struct instruction *insn, struct bb_state *state)
 	output_insn(state, "mov.%d %s,%s", insn->size, input, dst->name);
 }
 
+/* The read-only copies of the OP_INIT data, output after the function */
+static struct instruction_list *init_data;
+
+static void generate_init(struct instruction *insn, struct bb_state *state)
+{
+	output_insn(state, "copy $%d,.Linit%p,%s", insn->size >> 3, insn, address(state, insn));
+	add_instruction(&init_data, insn);
+}
+
+static void output_init_data(void)
+{
+	struct instruction *insn;
+
+	if (!init_data)
+		return;
+	printf("\t.section .rodata\n");
+	FOR_EACH_PTR(init_data, insn) {
+		unsigned int size = insn->size >> 3;
+		unsigned char *buf = malloc(size);
+
+		if (!buf)
+			die("out of memory");
+		initializer_bytes(insn->val, buf, size);
+		printf(".Linit%p:\n", insn);
+		show_initializer_bytes(buf, size);
+		free(buf);
+	} END_FOR_EACH_PTR(insn);
+	printf("\t.text\n");
+	free_ptr_list(&init_data);
+}
+
 static void kill_pseudo(struct bb_state *state, pseudo_t pseudo)
 {
 	int i;
@@ -1094,14 +1126,85 @@ static void generate_branch(struct bb_state *state, struct instruction *br)
 	output_insn(state, "jmp .L%p", target);
 }
 
+/*
+ * Half of the cases are below the middle one and half above, so it
+ * takes log(nr) compares to find the right one.
+ */
+static void generate_switch_tree(struct bb_state *state, const char *reg,
+	struct multijmp **cases, int nr, struct basic_block *def)
+{
+	int mid = nr / 2;
+	struct multijmp *jmp;
+
+	if (!nr) {
+		output_insn(state, "jmp .L%p", def);
+		return;
+	}
+	jmp = cases[mid];
+	output_insn(state, "cmpl $%d,%s", jmp->begin, reg);
+	if (mid)
+		output_insn(state, "jl .Lsw%p", jmp);
+	else
+		output_insn(state, "jl .L%p", def);
+	if (jmp->end != jmp->begin)
+		output_insn(state, "cmpl $%d,%s", jmp->end, reg);
+	output_insn(state, "jle .L%p", jmp->target);
+	generate_switch_tree(state, reg, cases + mid + 1, nr - mid - 1, def);
+	if (mid) {
+		output_label(state, ".Lsw%p", jmp);
+		generate_switch_tree(state, reg, cases, mid, def);
+	}
+}
+
+static void generate_switch_table(struct bb_state *state, const char *reg,
+	struct instruction *insn, struct switch_info *info)
+{
+	long long val = info->low;
+	struct multijmp *jmp;
+
+	output_insn(state, "subl $%lld,%s", info->low, reg);
+	output_insn(state, "cmpl $%lld,%s", info->high - info->low, reg);
+	output_insn(state, "ja .L%p", info->def);
+	output_insn(state, "jmp *.Lsw%p(,%s,4)", insn, reg);
+	output_label(state, ".Lsw%p", insn);
+	FOR_EACH_PTR(insn->multijmp_list, jmp) {
+		if (jmp->begin > jmp->end)
+			continue;
+		for (; val < jmp->begin; val++)
+			output_insn(state, ".long .L%p", info->def);
+		for (; val <= jmp->end; val++)
+			output_insn(state, ".long .L%p", jmp->target);
+	} END_FOR_EACH_PTR(jmp);
+}
+
 /* We've made sure that there is a dummy reg live for the output */
 static void generate_switch(struct bb_state *state, struct instruction *insn)
 {
 	struct hardreg *reg = hardregs + SWITCH_REG;
+	struct switch_info info;
+	struct multijmp **cases, *jmp;
+	int nr = 0;
 
 	generate_output_storage(state);
-	output_insn(state, "switch on %s", reg->name);
-	output_insn(state, "unimplemented: %s", show_instruction(insn));
+	get_switch_info(insn, &info);
+	if (switch_is_dense(&info)) {
+		generate_switch_table(state, reg->name, insn, &info);
+		return;
+	}
+
+	if (!info.nr) {
+		output_insn(state, "jmp .L%p", info.def);
+		return;
+	}
+	cases = malloc(info.nr * sizeof(*cases));
+	if (!cases)
+		die("out of memory");
+	FOR_EACH_PTR(insn->multijmp_list, jmp) {
+		if (jmp->begin <= jmp->end)
+			cases[nr++] = jmp;
+	} END_FOR_EACH_PTR(jmp);
+	generate_switch_tree(state, reg->name, cases, nr, info.def);
+	free(cases);
 }
 
 static void generate_ret(struct bb_state *state, struct instruction *ret)
@@ -1391,6 +1494,10 @@ static void generate_one_insn(struct instruction *insn, struct bb_state *state)
 		generate_store(insn, state);
 		break;
 
+	case OP_INIT:
+		generate_init(insn, state);
+		break;
+
 	case OP_LOAD:
 		generate_load(insn, state);
 		break;
@@ -1921,6 +2028,7 @@ static void output(struct entrypoint *ep)
 
 	/* Show the results ... */
 	output_bb(ep->entry->bb, generation);
+	output_init_data();
 
 	/* Clear the storage hashes for the next function.. */
 	free_storage();
@@ -48,6 +48,9 @@
 #define SELECT_COST 20		/* Cut-off for turning a conditional into a select */
 #define BRANCH_COST 10		/* Cost of a conditional branch */
 
+unsigned int expand_found;
+static int expand_depth;
+
 static int expand_expression(struct expression *);
 static int expand_statement(struct statement *);
 static int conservative;
@@ -564,10 +567,18 @@ static int expand_conditional(struct expression *expr)
 	return cost + cond_cost + BRANCH_COST;
 }
 		
+/* The linearizer can only store through a dereference */
+static void check_lvalue(struct expression *expr)
+{
+	if (expr && expr->ctype && !(expr->type == EXPR_PREOP && expr->op == '*'))
+		expand_found |= FOUND_INVALID;
+}
+
 static int expand_assignment(struct expression *expr)
 {
 	expand_expression(expr->left);
 	expand_expression(expr->right);
+	check_lvalue(expr->left);
 	return SIDE_EFFECTS;
 }
 
@@ -724,6 +735,7 @@ static int simplify_float_preop(struct expression *expr)
 static int expand_postop(struct expression *expr)
 {
 	expand_expression(expr->unop);
+	check_lvalue(expr->unop);
 	return SIDE_EFFECTS;
 }
 
@@ -835,6 +847,11 @@ static int expand_call(struct expression *expr)
 		expression_error(expr, "function has no type");
 		return SIDE_EFFECTS;
 	}
+	expand_found |= FOUND_CALL;
+	if (!expr->ctype)
+		expand_found |= FOUND_INVALID;
+	if (sym->ctype.contexts)
+		expand_found |= FOUND_CONTEXT;
 	if (sym->type == SYM_NODE)
 		return expand_symbol_call(expr, cost);
 
@@ -1052,6 +1069,7 @@ static void expand_const_expression(struct expression *expr, const char *where)
 
 int expand_symbol(struct symbol *sym)
 {
+	enum alloc_phase phase;
 	int retval;
 	struct symbol *base_type;
 
@@ -1061,12 +1079,20 @@ int expand_symbol(struct symbol *sym)
 	if (!base_type)
 		return 0;
 
+	phase = set_alloc_phase(ALLOC_PHASE_EXPAND);
+	/* The locals of a function are expanded as part of it */
+	if (!expand_depth++)
+		expand_found = 0;
+	if (sym->ctype.contexts)
+		expand_found |= FOUND_CONTEXT;
 	retval = expand_expression(sym->initializer);
 	/* expand the body of the symbol */
 	if (base_type->type == SYM_FN) {
 		if (base_type->stmt)
 			expand_statement(base_type->stmt);
 	}
+	expand_depth--;
+	set_alloc_phase(phase);
 	return retval;
 }
 
@@ -1139,6 +1165,13 @@ static int expand_compound(struct statement *stmt)
 	return cost;
 }
 
+/* A loop or switch label is bound when linearized, it can't be twice */
+static void check_label(struct symbol *label)
+{
+	if (label && label->bb_target)
+		expand_found |= FOUND_INVALID;
+}
+
 static int expand_statement(struct statement *stmt)
 {
 	if (!stmt)
@@ -1167,6 +1200,8 @@ static int expand_statement(struct statement *stmt)
 		return expand_if_statement(stmt);
 
 	case STMT_ITERATOR:
+		check_label(stmt->iterator_break);
+		check_label(stmt->iterator_continue);
 		expand_expression(stmt->iterator_pre_condition);
 		expand_expression(stmt->iterator_post_condition);
 		expand_statement(stmt->iterator_pre_statement);
@@ -1175,6 +1210,7 @@ static int expand_statement(struct statement *stmt)
 		return SIDE_EFFECTS;
 
 	case STMT_SWITCH:
+		check_label(stmt->switch_break);
 		expand_expression(stmt->switch_expression);
 		expand_statement(stmt->switch_statement);
 		return SIDE_EFFECTS;
@@ -1197,11 +1233,14 @@ static int expand_statement(struct statement *stmt)
 		break;
 	case STMT_ASM:
 		/* FIXME! Do the asm parameter evaluation! */
+		expand_found |= FOUND_ASM;
 		break;
 	case STMT_CONTEXT:
+		expand_found |= FOUND_CONTEXT;
 		expand_expression(stmt->expression);
 		break;
 	case STMT_RANGE:
+		expand_found |= FOUND_RANGE;
 		expand_expression(stmt->range_expression);
 		expand_expression(stmt->range_low);
 		expand_expression(stmt->range_high);
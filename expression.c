@@ -247,7 +247,7 @@ static unsigned long long parse_num(const char *nptr, char **end)
 
 static void get_number_value(struct expression *expr, struct token *token)
 {
-	const char *str = token->number;
+	const char *str = token_number(token);
 	unsigned long long value;
 	char *end;
 	int size = 0, want_unsigned = 0;
@@ -383,6 +383,7 @@ struct token *primary_expression(struct token *token, struct expression **tree)
 		break;
 
 	case TOKEN_NUMBER:
+	case TOKEN_NUMBER_EMBEDDED:
 		expr = alloc_expression(token->pos, EXPR_VALUE);
 		get_number_value(expr, token); /* will see if it's an integer */
 		token = token->next;
@@ -194,6 +194,18 @@ extern struct symbol *evaluate_expression(struct expression *);
 
 extern int expand_symbol(struct symbol *);
 
+/*
+ * What expand_symbol() came across in the function it expanded
+ * last, for telling whether the checks on the linearized code
+ * could find anything in it (see sparse.c).
+ */
+#define FOUND_CALL	1
+#define FOUND_CONTEXT	2	/* __context__, or a call to a function with contexts */
+#define FOUND_RANGE	4	/* __range__ */
+#define FOUND_ASM	8	/* inline asm */
+#define FOUND_INVALID	16	/* something the linearizer will warn about */
+extern unsigned int expand_found;
+
 static inline struct expression *alloc_expression(struct position pos, int type)
 {
 	struct expression *expr = __alloc_expression(0);
@@ -35,6 +35,7 @@ static int rewrite_branch(struct basic_block *bb,
 
 	/* We might find new if-conversions or non-dominating CSEs */
 	repeat_phase |= REPEAT_CSE;
+	cfg_changed(bb);
 	*ptr = new;
 	replace_bb_in_list(&bb->children, old, new, 1);
 	remove_bb_from_list(&old->parents, bb, 1);
@@ -135,6 +136,7 @@ static int bb_has_side_effects(struct basic_block *bb)
 			return 1;
 
 		case OP_STORE:
+		case OP_INIT:
 		case OP_CONTEXT:
 			return 1;
 
@@ -231,11 +233,6 @@ int simplify_flow(struct entrypoint *ep)
 	return simplify_branch_nodes(ep);
 }
 
-static inline void concat_user_list(struct pseudo_user_list *src, struct pseudo_user_list **dst)
-{
-	concat_ptr_list((struct ptr_list *)src, (struct ptr_list **)dst);
-}
-
 void convert_instruction_target(struct instruction *insn, pseudo_t src)
 {
 	pseudo_t target;
@@ -246,14 +243,13 @@ void convert_instruction_target(struct instruction *insn, pseudo_t src)
 	target = insn->target;
 	if (target == src)
 		return;
-	FOR_EACH_PTR(target->users, pu) {
+	FOR_EACH_USER(target, pu) {
 		if (*pu->userp != VOID) {
 			assert(*pu->userp == target);
 			*pu->userp = src;
 		}
-	} END_FOR_EACH_PTR(pu);
-	concat_user_list(target->users, &src->users);
-	target->users = NULL;
+	} END_FOR_EACH_USER(pu);
+	move_pseudo_users(target, src);
 }
 
 void convert_load_instruction(struct instruction *insn, pseudo_t src)
@@ -295,7 +291,7 @@ int dominates(pseudo_t pseudo, struct instruction *insn, struct instruction *dom
 
 	if (opcode == OP_CALL || opcode == OP_ENTRY)
 		return local ? 0 : -1;
-	if (opcode != OP_LOAD && opcode != OP_STORE)
+	if (opcode != OP_LOAD && opcode != OP_STORE && opcode != OP_INIT)
 		return 0;
 	if (dom->src != pseudo) {
 		if (local)
@@ -306,6 +302,9 @@ int dominates(pseudo_t pseudo, struct instruction *insn, struct instruction *dom
 		/* We could try to do some alias analysis here */
 		return -1;
 	}
+	/* It's all of it, but not a value we could use */
+	if (opcode == OP_INIT)
+		return -1;
 	if (!same_memop(insn, dom)) {
 		if (dom->opcode == OP_LOAD)
 			return 0;
@@ -400,7 +399,7 @@ void rewrite_load_instruction(struct instruction *insn, struct pseudo_list *domi
 complex_phi:
 	/* We leave symbol pseudos with a bogus usage list here */
 	if (insn->src->type != PSEUDO_SYM)
-		kill_use(&insn->src);
+		kill_use(insn, &insn->src);
 	insn->opcode = OP_PHI;
 	insn->phi_list = dominators;
 }
@@ -476,12 +475,12 @@ found:
 	return 1;
 }
 
-static void kill_store(struct instruction *insn)
+void kill_store(struct instruction *insn)
 {
 	if (insn) {
 		insn->bb = NULL;
 		insn->opcode = OP_SNOP;
-		kill_use(&insn->target);
+		kill_use(insn, &insn->target);
 	}
 }
 
@@ -497,7 +496,7 @@ static void kill_dead_stores(pseudo_t pseudo, unsigned long generation, struct b
 	FOR_EACH_PTR_REVERSE(bb->insns, insn) {
 		int opcode = insn->opcode;
 
-		if (opcode != OP_LOAD && opcode != OP_STORE) {
+		if (opcode != OP_LOAD && opcode != OP_STORE && opcode != OP_INIT) {
 			if (local)
 				continue;
 			if (opcode == OP_CALL)
@@ -581,7 +580,7 @@ void check_access(struct instruction *insn)
 {
 	pseudo_t pseudo = insn->src;
 
-	if (insn->bb && pseudo->type == PSEUDO_SYM) {
+	if (Wlinearize && insn->bb && pseudo->type == PSEUDO_SYM) {
 		int offset = insn->offset, bit = bytes_to_bits(offset) + insn->size;
 		struct symbol *sym = pseudo->sym;
 
@@ -618,7 +617,7 @@ static void simplify_one_symbol(struct entrypoint *ep, struct symbol *sym)
 	def = NULL;
 	stores = 0;
 	complex = 0;
-	FOR_EACH_PTR(pseudo->users, pu) {
+	FOR_EACH_USER(pseudo, pu) {
 		/* We know that the symbol-pseudo use is the "src" in the instruction */
 		struct instruction *insn = pu->insn;
 
@@ -629,6 +628,9 @@ static void simplify_one_symbol(struct entrypoint *ep, struct symbol *sym)
 			break;
 		case OP_LOAD:
 			break;
+		case OP_INIT:
+			complex = 1;
+			break;
 		case OP_SYMADDR:
 			if (!insn->bb)
 				continue;
@@ -643,12 +645,15 @@ static void simplify_one_symbol(struct entrypoint *ep, struct symbol *sym)
 			warning(sym->pos, "symbol '%s' pseudo used in unexpected way", show_ident(sym->ident));
 		}
 		complex |= insn->offset;
-	} END_FOR_EACH_PTR(pu);
+	} END_FOR_EACH_USER(pu);
 
 	if (complex)
 		goto complex_def;
-	if (stores > 1)
+	if (stores > 1) {
+		if (cytron_ssa && ssa_convert_symbol(ep, pseudo))
+			return;
 		goto multi_def;
+	}
 
 	/*
 	 * Goodie, we have a single store (if even that) in the whole
@@ -659,13 +664,13 @@ static void simplify_one_symbol(struct entrypoint *ep, struct symbol *sym)
 	if (def)
 		src = def->target;
 
-	FOR_EACH_PTR(pseudo->users, pu) {
+	FOR_EACH_USER(pseudo, pu) {
 		struct instruction *insn = pu->insn;
 		if (insn->opcode == OP_LOAD) {
 			check_access(insn);
 			convert_load_instruction(insn, src);
 		}
-	} END_FOR_EACH_PTR(pu);
+	} END_FOR_EACH_USER(pu);
 
 	/* Turn the store into a no-op */
 	kill_store(def);
@@ -675,29 +680,29 @@ multi_def:
 complex_def:
 external_visibility:
 	all = 1;
-	FOR_EACH_PTR_REVERSE(pseudo->users, pu) {
+	FOR_EACH_USER_REVERSE(pseudo, pu) {
 		struct instruction *insn = pu->insn;
 		if (insn->opcode == OP_LOAD)
 			all &= find_dominating_stores(pseudo, insn, ++bb_generation, !mod);
-	} END_FOR_EACH_PTR_REVERSE(pu);
+	} END_FOR_EACH_USER_REVERSE(pu);
 
 	/* If we converted all the loads, remove the stores. They are dead */
 	if (all && !mod) {
-		FOR_EACH_PTR(pseudo->users, pu) {
+		FOR_EACH_USER(pseudo, pu) {
 			struct instruction *insn = pu->insn;
-			if (insn->opcode == OP_STORE)
+			if (insn->opcode == OP_STORE || insn->opcode == OP_INIT)
 				kill_store(insn);
-		} END_FOR_EACH_PTR(pu);
+		} END_FOR_EACH_USER(pu);
 	} else {
 		/*
 		 * If we couldn't take the shortcut, see if we can at least kill some
 		 * of them..
 		 */
-		FOR_EACH_PTR(pseudo->users, pu) {
+		FOR_EACH_USER(pseudo, pu) {
 			struct instruction *insn = pu->insn;
 			if (insn->opcode == OP_STORE)
 				kill_dominated_stores(pseudo, insn, ++bb_generation, insn->bb, !mod, 0);
-		} END_FOR_EACH_PTR(pu);
+		} END_FOR_EACH_USER(pu);
 
 		if (!(mod & (MOD_NONLOCAL | MOD_STATIC))) {
 			struct basic_block *bb;
@@ -760,6 +765,7 @@ void kill_bb(struct basic_block *bb)
 	} END_FOR_EACH_PTR(insn);
 	bb->insns = NULL;
 
+	cfg_changed(bb);
 	FOR_EACH_PTR(bb->children, child) {
 		remove_bb_from_list(&child->parents, bb, 0);
 	} END_FOR_EACH_PTR(child);
@@ -979,6 +985,7 @@ out:
 		 * Merge the two.
 		 */
 		repeat_phase |= REPEAT_CSE;
+		cfg_changed(bb);
 
 		parent->children = bb->children;
 		bb->children = NULL;
@@ -20,13 +20,18 @@ extern void pack_basic_blocks(struct entrypoint *ep);
 extern void convert_instruction_target(struct instruction *insn, pseudo_t src);
 extern void cleanup_and_cse(struct entrypoint *ep);
 extern int simplify_instruction(struct instruction *);
+extern int eval_binop(int opcode, unsigned int size, long long left, long long right, long long *res);
+extern int eval_unop(int opcode, unsigned int size, long long val, long long *res);
+extern int eval_cast(struct instruction *insn, long long val, long long *res);
 
 extern void kill_bb(struct basic_block *);
-extern void kill_use(pseudo_t *);
+extern void kill_use(struct instruction *insn, pseudo_t *);
 extern void kill_instruction(struct instruction *);
 extern void kill_unreachable_bbs(struct entrypoint *ep);
 
 void check_access(struct instruction *insn);
+void kill_store(struct instruction *insn);
+int ssa_convert_symbol(struct entrypoint *ep, pseudo_t pseudo);
 void convert_load_instruction(struct instruction *, pseudo_t);
 void rewrite_load_instruction(struct instruction *, struct pseudo_list *);
 int dominates(pseudo_t pseudo, struct instruction *insn, struct instruction *dom, int local);
@@ -36,6 +41,29 @@ extern void track_pseudo_liveness(struct entrypoint *ep);
 extern void track_pseudo_death(struct entrypoint *ep);
 extern void track_phi_uses(struct instruction *insn);
 
+extern void build_dom_tree(struct entrypoint *ep);
+extern void build_dom_frontiers(struct entrypoint *ep);
+
+extern int simplify_constants(struct entrypoint *ep);
+
+/* The passes linearize_fn() runs, see pass.c */
+enum pass_id {
+	PASS_UNREACHABLE,
+	PASS_SYMBOLS,
+	PASS_SCCP,
+	PASS_CSE,
+	PASS_PACK,
+	PASS_LIVENESS,
+	PASS_FLOW,
+	PASS_DEATH,
+	NR_PASSES
+};
+
+extern int run_pass(struct entrypoint *ep, enum pass_id id);
+extern const char *select_passes(const char *list);
+extern void show_pass_stats(struct entrypoint *ep);
+extern void show_all_pass_stats(void);
+
 extern void vrfy_flow(struct entrypoint *ep);
 extern int pseudo_in_list(struct pseudo_list *list, pseudo_t pseudo);
 
@@ -42,7 +42,9 @@
 #include "expression.h"
 #include "scope.h"
 #include "linearize.h"
+#include "flow.h"
 #include "target.h"
+#include "compat.h"
 #include "version.h"
 
 int verbose, optimize, optimize_size, preprocessing;
@@ -218,6 +220,8 @@ int Wdefault_bitfield_sign = 0;
 int Wdesignated_init = 1;
 int Wdo_while = 0;
 int Winit_cstring = 0;
+int Wlinearize = 1;
+int Wmemcpy_max_count = 1;
 int Wenum_mismatch = 1;
 int Wnon_pointer_null = 1;
 int Wold_initializer = 1;
@@ -234,8 +238,13 @@ int Wvla = 1;
 
 int dbg_entry = 0;
 int dbg_dead = 0;
+int dbg_liveness_iterate = 0;
 
 int preprocess_only;
+int mem_report = MEM_REPORT_NONE;
+int cytron_ssa = 0;
+int strict_aliasing = 0;
+int per_file_memory = 0;
 
 static enum { STANDARD_C89,
               STANDARD_C94,
@@ -267,6 +276,8 @@ void add_pre_buffer(const char *fmt, ...)
 	va_start(args, fmt);
 	size = vsnprintf(buffer, sizeof(buffer), fmt, args);
 	va_end(args);
+	if (size >= sizeof(buffer))
+		size = sizeof(buffer) - 1;
 	begin = tokenize_buffer(buffer, size, &end);
 	if (!pre_buffer_begin)
 		pre_buffer_begin = begin;
@@ -431,6 +442,8 @@ static const struct warning {
 	{ "do-while", &Wdo_while },
 	{ "enum-mismatch", &Wenum_mismatch },
 	{ "init-cstring", &Winit_cstring },
+	{ "linearize", &Wlinearize },
+	{ "memcpy-max-count", &Wmemcpy_max_count },
 	{ "non-pointer-null", &Wnon_pointer_null },
 	{ "old-initializer", &Wold_initializer },
 	{ "one-bit-signed-bitfield", &Wone_bit_signed_bitfield },
@@ -497,6 +510,7 @@ static char **handle_switch_W(char *arg, char **next)
 static struct warning debugs[] = {
 	{ "entry", &dbg_entry},
 	{ "dead", &dbg_dead},
+	{ "liveness-iterate", &dbg_liveness_iterate},
 };
 
 
@@ -589,19 +603,78 @@ static char **handle_switch_ftabstop(char *arg, char **next)
 	return next;
 }
 
+static char **handle_switch_fblob_cache(char *arg, char **next)
+{
+	char *end;
+	unsigned long val;
+
+	if (*arg == '\0')
+		die("error: missing argument to \"-fblob-cache=\"");
+
+	/* the size is in megabytes */
+	val = strtoul(arg, &end, 10);
+	if (*end != '\0')
+		die("error: bad argument to \"-fblob-cache=\": %s", arg);
+	blob_cache_size = val << 20;
+
+	return next;
+}
+
+static char **handle_switch_fmem_report(char *arg, char **next)
+{
+	if (!strcmp(arg, "json"))
+		mem_report = MEM_REPORT_JSON;
+	else if (!strcmp(arg, "text"))
+		mem_report = MEM_REPORT_TEXT;
+	else
+		die("error: bad argument to \"-fmem-report=\": %s", arg);
+	return next;
+}
+
+static char **handle_switch_fpasses(char *arg, char **next)
+{
+	const char *bad = select_passes(arg);
+
+	if (bad)
+		die("error: bad argument to \"-fpasses=\": no optional pass '%.*s'",
+			(int) strcspn(bad, ","), bad);
+	return next;
+}
+
 static char **handle_switch_f(char *arg, char **next)
 {
+	int flag = 1;
+
 	arg++;
 
 	if (!strncmp(arg, "tabstop=", 8))
 		return handle_switch_ftabstop(arg+8, next);
+	if (!strncmp(arg, "blob-cache=", 11))
+		return handle_switch_fblob_cache(arg+11, next);
+	if (!strncmp(arg, "mem-report=", 11))
+		return handle_switch_fmem_report(arg+11, next);
+	if (!strncmp(arg, "passes=", 7))
+		return handle_switch_fpasses(arg+7, next);
 
 	/* handle switches w/ arguments above, boolean and only boolean below */
 
 	if (!strncmp(arg, "no-", 3)) {
+		flag = 0;
 		arg += 3;
 	}
 	/* handle switch here.. */
+	if (!strcmp(arg, "huge-blobs"))
+		blob_huge_blobs = flag;
+	else if (!strcmp(arg, "mem-report"))
+		mem_report = flag ? MEM_REPORT_TEXT : MEM_REPORT_NONE;
+	else if (!strcmp(arg, "cytron-ssa"))
+		cytron_ssa = flag;
+	else if (!strcmp(arg, "strict-aliasing"))
+		strict_aliasing = flag;
+	else if (!strcmp(arg, "dump-pass-stats"))
+		dump_pass_stats = flag;
+	else if (!strcmp(arg, "per-file-memory"))
+		per_file_memory = flag;
 	return next;
 }
 
@@ -932,6 +1005,8 @@ void create_builtin_stream(void)
 
 static struct symbol_list *sparse_tokenstream(struct token *token)
 {
+	enum alloc_phase phase;
+
 	// Preprocess the stream
 	token = preprocess(token);
 
@@ -957,8 +1032,10 @@ static struct symbol_list *sparse_tokenstream(struct token *token)
 	}
 
 	// Parse the resulting C code
+	phase = set_alloc_phase(ALLOC_PHASE_PARSE);
 	while (!eof_token(token))
 		token = external_declaration(token, &translation_unit_used_list);
+	set_alloc_phase(phase);
 	return translation_unit_used_list;
 }
 
@@ -1049,6 +1126,59 @@ struct symbol_list *sparse_initialize(int argc, char **argv, struct string_list
 	return list;
 }
 
+/*
+ * Drivers that check many files in one run can take a checkpoint
+ * once the builtins and the command line includes are set up, and
+ * roll back to it after each file is done with. Everything the
+ * file allocated is then reused for the next one, so memory use
+ * is that of the biggest file rather than the sum of all of them.
+ * The price is that nothing declared by one file is seen by the
+ * next: conflicts between files are not found any more.
+ */
+static struct symbol **checkpoint_definitions;
+
+void sparse_checkpoint(void)
+{
+	struct symbol *sym;
+	int nr = 0;
+
+	mark_global_scope();
+	mark_fouled_types();
+	mark_streams();
+	mark_all_allocations();
+
+	/* Later files may define functions we have only seen declared */
+	free(checkpoint_definitions);
+	checkpoint_definitions = malloc((symbol_list_size(global_scope->symbols) + 1) * sizeof(struct symbol *));
+	FOR_EACH_PTR(global_scope->symbols, sym) {
+		checkpoint_definitions[nr++] = sym->namespace == NS_SYMBOL ? sym->definition : NULL;
+	} END_FOR_EACH_PTR(sym);
+}
+
+void sparse_rollback(void)
+{
+	struct symbol *sym;
+	int nr = 0;
+
+	rollback_global_scope();
+	rollback_fouled_types();
+	rollback_streams();
+
+	/* The surviving symbols must not point into what we drop */
+	FOR_EACH_PTR(global_scope->symbols, sym) {
+		sym->pseudo = NULL;
+		if (sym->namespace == NS_SYMBOL)
+			sym->definition = checkpoint_definitions[nr];
+		else if (sym->namespace == NS_MACRO)
+			sym->used_in = NULL;
+		nr++;
+	} END_FOR_EACH_PTR(sym);
+	translation_unit_used_list = NULL;
+	clear_shared_pseudos();
+
+	rollback_all_allocations();
+}
+
 struct symbol_list * sparse_keep_tokens(char *filename)
 {
 	struct symbol_list *res;
@@ -1086,3 +1216,15 @@ struct symbol_list * sparse(char *filename)
 
 	return res;
 }
+
+void show_mem_report(void)
+{
+	switch (mem_report) {
+	case MEM_REPORT_TEXT:
+		show_all_allocations();
+		break;
+	case MEM_REPORT_JSON:
+		show_all_allocations_json();
+		break;
+	}
+}
@@ -113,6 +113,8 @@ extern int Wdesignated_init;
 extern int Wdo_while;
 extern int Wenum_mismatch;
 extern int Winit_cstring;
+extern int Wlinearize;
+extern int Wmemcpy_max_count;
 extern int Wnon_pointer_null;
 extern int Wold_initializer;
 extern int Wone_bit_signed_bitfield;
@@ -128,15 +130,30 @@ extern int Wvla;
 
 extern int dbg_entry;
 extern int dbg_dead;
+extern int dbg_liveness_iterate;
 
 extern int arch_m64;
 
+enum {
+	MEM_REPORT_NONE,
+	MEM_REPORT_TEXT,
+	MEM_REPORT_JSON,
+};
+extern int mem_report;
+extern int cytron_ssa;
+extern int strict_aliasing;
+extern int per_file_memory;
+extern int dump_pass_stats;
+
 extern void declare_builtin_functions(void);
 extern void create_builtin_stream(void);
 extern struct symbol_list *sparse_initialize(int argc, char **argv, struct string_list **files);
 extern struct symbol_list *__sparse(char *filename);
 extern struct symbol_list *sparse_keep_tokens(char *filename);
 extern struct symbol_list *sparse(char *filename);
+extern void sparse_checkpoint(void);
+extern void sparse_rollback(void);
+extern void show_mem_report(void);
 
 static inline int symbol_list_size(struct symbol_list *list)
 {
@@ -187,6 +204,10 @@ static inline struct basic_block *first_basic_block(struct basic_block_list *hea
 {
 	return first_ptr_list((struct ptr_list *)head);
 }
+static inline struct basic_block *last_basic_block(struct basic_block_list *head)
+{
+	return last_ptr_list((struct ptr_list *)head);
+}
 static inline struct instruction *last_instruction(struct instruction_list *head)
 {
 	return last_ptr_list((struct ptr_list *)head);
@@ -67,7 +67,9 @@ static struct entrypoint *alloc_entrypoint(void)
 
 static struct basic_block *alloc_basic_block(struct entrypoint *ep, struct position pos)
 {
+	static int nr = 0;
 	struct basic_block *bb = __alloc_basic_block(0);
+	bb->nr = ++nr;
 	bb->context = -1;
 	bb->pos = pos;
 	bb->ep = ep;
@@ -109,7 +111,7 @@ const char *show_pseudo(pseudo_t pseudo)
 		struct expression *expr;
 
 		if (sym->bb_target) {
-			snprintf(buf, 64, ".L%p", sym->bb_target);
+			snprintf(buf, 64, ".L%d", sym->bb_target->nr);
 			break;
 		}
 		if (sym->ident) {
@@ -217,6 +219,7 @@ static const char *opcodes[] = {
 	[OP_ALLOCA] = "alloca",
 	[OP_LOAD] = "load",
 	[OP_STORE] = "store",
+	[OP_INIT] = "init",
 	[OP_SETVAL] = "set",
 	[OP_SYMADDR] = "symaddr",
 	[OP_GET_ELEMENT_PTR] = "getelem",
@@ -303,10 +306,10 @@ const char *show_instruction(struct instruction *insn)
 		break;
 	case OP_BR:
 		if (insn->bb_true && insn->bb_false) {
-			buf += sprintf(buf, "%s, .L%p, .L%p", show_pseudo(insn->cond), insn->bb_true, insn->bb_false);
+			buf += sprintf(buf, "%s, .L%d, .L%d", show_pseudo(insn->cond), insn->bb_true->nr, insn->bb_false->nr);
 			break;
 		}
-		buf += sprintf(buf, ".L%p", insn->bb_true ? insn->bb_true : insn->bb_false);
+		buf += sprintf(buf, ".L%d", (insn->bb_true ? insn->bb_true : insn->bb_false)->nr);
 		break;
 
 	case OP_SYMADDR: {
@@ -314,7 +317,7 @@ const char *show_instruction(struct instruction *insn)
 		buf += sprintf(buf, "%s <- ", show_pseudo(insn->target));
 
 		if (sym->bb_target) {
-			buf += sprintf(buf, ".L%p", sym->bb_target);
+			buf += sprintf(buf, ".L%d", sym->bb_target->nr);
 			break;
 		}
 		if (sym->ident) {
@@ -348,7 +351,7 @@ const char *show_instruction(struct instruction *insn)
 			buf += sprintf(buf, "%s", show_ident(expr->symbol->ident));
 			break;
 		case EXPR_LABEL:
-			buf += sprintf(buf, ".L%p", expr->symbol->bb_target);
+			buf += sprintf(buf, ".L%d", expr->symbol->bb_target->nr);
 			break;
 		default:
 			buf += sprintf(buf, "SETVAL EXPR TYPE %d", expr->type);
@@ -360,11 +363,11 @@ const char *show_instruction(struct instruction *insn)
 		buf += sprintf(buf, "%s", show_pseudo(insn->target));
 		FOR_EACH_PTR(insn->multijmp_list, jmp) {
 			if (jmp->begin == jmp->end)
-				buf += sprintf(buf, ", %d -> .L%p", jmp->begin, jmp->target);
+				buf += sprintf(buf, ", %d -> .L%d", jmp->begin, jmp->target->nr);
 			else if (jmp->begin < jmp->end)
-				buf += sprintf(buf, ", %d ... %d -> .L%p", jmp->begin, jmp->end, jmp->target);
+				buf += sprintf(buf, ", %d ... %d -> .L%d", jmp->begin, jmp->end, jmp->target->nr);
 			else
-				buf += sprintf(buf, ", default -> .L%p", jmp->target);
+				buf += sprintf(buf, ", default -> .L%d", jmp->target->nr);
 		} END_FOR_EACH_PTR(jmp);
 		break;
 	}
@@ -372,7 +375,7 @@ const char *show_instruction(struct instruction *insn)
 		struct multijmp *jmp;
 		buf += sprintf(buf, "%s", show_pseudo(insn->target));
 		FOR_EACH_PTR(insn->multijmp_list, jmp) {
-			buf += sprintf(buf, ", .L%p", jmp->target);
+			buf += sprintf(buf, ", .L%d", jmp->target->nr);
 		} END_FOR_EACH_PTR(jmp);
 		break;
 	}
@@ -402,6 +405,9 @@ const char *show_instruction(struct instruction *insn)
 	case OP_STORE: case OP_SNOP:
 		buf += sprintf(buf, "%s -> %d[%s]", show_pseudo(insn->target), insn->offset, show_pseudo(insn->src));
 		break;
+	case OP_INIT:
+		buf += sprintf(buf, "{...} -> %d[%s]", insn->offset, show_pseudo(insn->src));
+		break;
 	case OP_INLINED_CALL:
 	case OP_CALL: {
 		struct pseudo *arg;
@@ -473,7 +479,7 @@ void show_bb(struct basic_block *bb)
 {
 	struct instruction *insn;
 
-	printf(".L%p:\n", bb);
+	printf(".L%d:\n", bb->nr);
 	if (verbose) {
 		pseudo_t needs, defines;
 		printf("%s:%d\n", stream_name(bb->pos.stream), bb->pos.line);
@@ -481,7 +487,7 @@ void show_bb(struct basic_block *bb)
 		FOR_EACH_PTR(bb->needs, needs) {
 			struct instruction *def = needs->def;
 			if (def->opcode != OP_PHI) {
-				printf("  **uses %s (from .L%p)**\n", show_pseudo(needs), def->bb);
+				printf("  **uses %s (from .L%d)**\n", show_pseudo(needs), def->bb->nr);
 			} else {
 				pseudo_t phi;
 				const char *sep = " ";
@@ -489,7 +495,7 @@ void show_bb(struct basic_block *bb)
 				FOR_EACH_PTR(def->phi_list, phi) {
 					if (phi == VOID)
 						continue;
-					printf("%s(%s:.L%p)", sep, show_pseudo(phi), phi->def->bb);
+					printf("%s(%s:.L%d)", sep, show_pseudo(phi), phi->def->bb->nr);
 					sep = ", ";
 				} END_FOR_EACH_PTR(phi);		
 				printf(")**\n");
@@ -503,7 +509,7 @@ void show_bb(struct basic_block *bb)
 		if (bb->parents) {
 			struct basic_block *from;
 			FOR_EACH_PTR(bb->parents, from) {
-				printf("  **from %p (%s:%d:%d)**\n", from,
+				printf("  **from .L%d (%s:%d:%d)**\n", from->nr,
 					stream_name(from->pos.stream), from->pos.line, from->pos.pos);
 			} END_FOR_EACH_PTR(from);
 		}
@@ -511,7 +517,7 @@ void show_bb(struct basic_block *bb)
 		if (bb->children) {
 			struct basic_block *to;
 			FOR_EACH_PTR(bb->children, to) {
-				printf("  **to %p (%s:%d:%d)**\n", to,
+				printf("  **to .L%d (%s:%d:%d)**\n", to->nr,
 					stream_name(to->pos.stream), to->pos.line, to->pos.pos);
 			} END_FOR_EACH_PTR(to);
 		}
@@ -531,9 +537,9 @@ static void show_symbol_usage(pseudo_t pseudo)
 	struct pseudo_user *pu;
 
 	if (pseudo) {
-		FOR_EACH_PTR(pseudo->users, pu) {
+		FOR_EACH_USER(pseudo, pu) {
 			printf("\t%s\n", show_instruction(pu->insn));
-		} END_FOR_EACH_PTR(pu);
+		} END_FOR_EACH_USER(pu);
 	}
 }
 
@@ -654,6 +660,7 @@ void insert_branch(struct basic_block *bb, struct instruction *jmp, struct basic
 	br->bb_true = target;
 	add_instruction(&bb->insns, br);
 
+	cfg_changed(bb);
 	FOR_EACH_PTR(bb->children, child) {
 		if (child == target) {
 			target = NULL;	/* Trigger just once */
@@ -774,12 +781,13 @@ static pseudo_t symbol_pseudo(struct entrypoint *ep, struct symbol *sym)
 	return pseudo;
 }
 
+#define MAX_VAL_HASH 64
+static struct pseudo_list *value_pseudos[MAX_VAL_HASH];
+
 pseudo_t value_pseudo(long long val)
 {
-#define MAX_VAL_HASH 64
-	static struct pseudo_list *prev[MAX_VAL_HASH];
 	int hash = val & (MAX_VAL_HASH-1);
-	struct pseudo_list **list = prev + hash;
+	struct pseudo_list **list = value_pseudos + hash;
 	pseudo_t pseudo;
 
 	FOR_EACH_PTR(*list, pseudo) {
@@ -796,6 +804,17 @@ pseudo_t value_pseudo(long long val)
 	return pseudo;
 }
 
+/*
+ * Forget the pseudos shared between functions, for when the
+ * memory they (and the users of VOID) live in is about to be
+ * reused.
+ */
+void clear_shared_pseudos(void)
+{
+	memset(value_pseudos, 0, sizeof(value_pseudos));
+	void_pseudo.users = NULL;
+}
+
 static pseudo_t argument_pseudo(struct entrypoint *ep, int nr)
 {
 	pseudo_t pseudo = __alloc_pseudo(0);
@@ -827,6 +846,28 @@ pseudo_t alloc_phi(struct basic_block *source, pseudo_t pseudo, int size)
 	return phi;
 }
 
+/*
+ * A new, still empty, phi-node at the start of "bb".
+ */
+struct instruction *insert_phi_node(struct basic_block *bb, int size)
+{
+	struct instruction *phi_node = alloc_instruction(OP_PHI, size);
+	struct instruction *insn;
+
+	phi_node->bb = bb;
+	phi_node->target = alloc_pseudo(phi_node);
+
+	FOR_EACH_PTR(bb->insns, insn) {
+		if (insn->opcode == OP_ENTRY || insn->opcode == OP_PHI)
+			continue;
+		INSERT_CURRENT(phi_node, insn);
+		return phi_node;
+	} END_FOR_EACH_PTR(insn);
+
+	add_instruction(&bb->insns, phi_node);
+	return phi_node;
+}
+
 /*
  * We carry the "access_data" structure around for any accesses,
  * which simplifies things a lot. It contains all the access
@@ -934,6 +975,18 @@ static void add_store(struct entrypoint *ep, struct access_data *ad, pseudo_t va
 	}
 }
 
+static void add_init(struct entrypoint *ep, struct symbol *sym, pseudo_t address)
+{
+	struct basic_block *bb = ep->active;
+
+	if (bb_reachable(bb)) {
+		struct instruction *init = alloc_typed_instruction(OP_INIT, sym);
+		init->val = sym->initializer;
+		use_pseudo(init, address, &init->src);
+		add_one_insn(ep, init);
+	}
+}
+
 static pseudo_t linearize_store_gen(struct entrypoint *ep,
 		pseudo_t value,
 		struct access_data *ad)
@@ -1526,6 +1579,130 @@ static pseudo_t linearize_initializer(struct entrypoint *ep, struct expression *
 	return VOID;
 }
 
+static void put_bits(unsigned char *buf, unsigned int pos, int bits, unsigned long long val)
+{
+	while (bits > 0) {
+		int shift = pos & 7;
+		int nr = bits < 8 - shift ? bits : 8 - shift;
+		unsigned char mask = ((1 << nr) - 1) << shift;
+
+		buf[pos >> 3] = (buf[pos >> 3] & ~mask) | ((val << shift) & mask);
+		val >>= nr;
+		pos += nr;
+		bits -= nr;
+	}
+}
+
+/*
+ * Count the values of an initializer, and lay them out in "buf"
+ * if there is one. -1 if some of it isn't an integer constant
+ * (or doesn't fit in "size" bytes).
+ */
+static int flatten_initializer(struct expression *expr, unsigned int offset,
+	unsigned char *buf, unsigned int size)
+{
+	struct expression *entry;
+	struct symbol *ctype;
+	int nr = 0;
+
+	switch (expr->type) {
+	case EXPR_INITIALIZER:
+		FOR_EACH_PTR(expr->expr_list, entry) {
+			int n = flatten_initializer(entry, offset, buf, size);
+			if (n < 0)
+				return n;
+			nr += n;
+		} END_FOR_EACH_PTR(entry);
+		return nr;
+	case EXPR_POS:
+		return flatten_initializer(expr->init_expr, expr->init_offset, buf, size);
+	case EXPR_VALUE:
+		ctype = expr->ctype;
+		if (!ctype || ctype->bit_size <= 0 || ctype->bit_size > 64)
+			return -1;
+		if (offset * 8ULL + ctype->bit_offset + ctype->bit_size > size * 8ULL)
+			return -1;
+		if (buf)
+			put_bits(buf, offset * 8 + ctype->bit_offset, ctype->bit_size, expr->value);
+		return 1;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Lay out a constant initializer as the bytes of the object it
+ * initializes (little-endian, like all of our backends). Returns
+ * 0 if it isn't made of integer constants only.
+ */
+int initializer_bytes(struct expression *init, unsigned char *buf, unsigned int size)
+{
+	memset(buf, 0, size);
+	return flatten_initializer(init, 0, buf, size) >= 0;
+}
+
+static unsigned int zero_run(const unsigned char *data, unsigned int i, unsigned int size)
+{
+	unsigned int nr = 0;
+
+	while (i + nr < size && !data[i + nr])
+		nr++;
+	return nr;
+}
+
+/*
+ * Print the bytes of an initializer as assembler data, for the
+ * backends, with the runs of zeroes (and the trailing ones)
+ * folded, even when they start in the middle of a line.
+ */
+void show_initializer_bytes(const unsigned char *data, unsigned int size)
+{
+	unsigned int i = 0;
+
+	while (i < size) {
+		unsigned int zeroes = zero_run(data, i, size), end;
+
+		if (zeroes >= 8 || i + zeroes == size) {
+			printf("\t.zero\t%u\n", zeroes);
+			i += zeroes;
+			continue;
+		}
+		end = i + 16 < size ? i + 16 : size;
+		printf("\t.byte\t%u", data[i]);
+		while (++i < end) {
+			zeroes = zero_run(data, i, size);
+			if (zeroes >= 8 || i + zeroes == size)
+				break;
+			printf(",%u", data[i]);
+		}
+		printf("\n");
+	}
+}
+
+/*
+ * Constant aggregates this big are linearized as a single OP_INIT
+ * of the whole object instead of a store per member: a backend can
+ * copy them from read-only data, and nobody wants to wade through
+ * thousands of stores. Smaller ones keep their stores, so that the
+ * loads from them can still be simplified.
+ */
+#define BULK_INIT_BITS	512
+
+int bulk_initializer(struct symbol *sym)
+{
+	struct symbol *base = sym->ctype.base_type;
+	struct expression *init = sym->initializer;
+
+	if (!init || init->type != EXPR_INITIALIZER || !base)
+		return 0;
+	if (base->type != SYM_ARRAY && base->type != SYM_STRUCT && base->type != SYM_UNION)
+		return 0;
+	/* the size has to fit in the instruction */
+	if (sym->bit_size < BULK_INIT_BITS || sym->bit_size >= 1 << 24 || (sym->bit_size & 7))
+		return 0;
+	return flatten_initializer(init, 0, NULL, sym->bit_size >> 3) >= 0;
+}
+
 static void linearize_argument(struct entrypoint *ep, struct symbol *arg, int nr)
 {
 	struct access_data ad = { NULL, };
@@ -1625,6 +1802,10 @@ static pseudo_t linearize_one_symbol(struct entrypoint *ep, struct symbol *sym)
 
 	sym->initialized = 1;
 	ad.address = symbol_pseudo(ep, sym);
+	if (bulk_initializer(sym)) {
+		add_init(ep, sym, ad.address);
+		return VOID;
+	}
 	value = linearize_initializer(ep, sym->initializer, &ad);
 	finish_address_gen(ep, &ad);
 	return value;
@@ -1839,6 +2020,68 @@ static void sort_switch_cases(struct instruction *insn)
 	sort_list((struct ptr_list **)&insn->multijmp_list, multijmp_cmp);
 }
 
+/*
+ * Where a switch goes for "val". The cases are sorted and don't
+ * overlap, so this is a binary search within the one node of the
+ * vector that can hold it.
+ */
+struct basic_block *switch_lookup(struct instruction *insn, long long val)
+{
+	struct ptr_list *head = (struct ptr_list *)insn->multijmp_list;
+	struct ptr_list *list = head;
+	struct multijmp *jmp;
+
+	if (!head)
+		return NULL;
+	do {
+		int lo = 0, hi = list->nr;
+
+		if (!hi)
+			continue;
+		jmp = PTR_ENTRY(list, hi - 1);
+		if (jmp->begin > jmp->end)
+			hi--;
+		if (!hi)
+			continue;
+		jmp = PTR_ENTRY(list, hi - 1);
+		if (val > jmp->end)
+			continue;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+
+			jmp = PTR_ENTRY(list, mid);
+			if (val < jmp->begin)
+				hi = mid;
+			else if (val > jmp->end)
+				lo = mid + 1;
+			else
+				return jmp->target;
+		}
+		break;
+	} while ((list = list->next) != head);
+
+	jmp = last_ptr_list(head);
+	return jmp->begin > jmp->end ? jmp->target : NULL;
+}
+
+void get_switch_info(struct instruction *insn, struct switch_info *info)
+{
+	struct multijmp *jmp;
+
+	info->nr = 0;
+	info->low = info->high = 0;
+	info->def = NULL;
+	FOR_EACH_PTR(insn->multijmp_list, jmp) {
+		if (jmp->begin > jmp->end) {
+			info->def = jmp->target;
+			continue;
+		}
+		if (!info->nr++)
+			info->low = jmp->begin;
+		info->high = jmp->end;
+	} END_FOR_EACH_PTR(jmp);
+}
+
 static pseudo_t linearize_declaration(struct entrypoint *ep, struct statement *stmt)
 {
 	struct symbol *sym;
@@ -2117,8 +2360,53 @@ pseudo_t linearize_statement(struct entrypoint *ep, struct statement *stmt)
 	return VOID;
 }
 
+static void mark_ir_arena(struct ir_arena *arena)
+{
+	mark_ptrlist_alloc(&arena->ptrlist);
+	mark_pseudo_alloc(&arena->pseudo);
+	mark_pseudo_user_alloc(&arena->pseudo_user);
+	mark_instruction_alloc(&arena->instruction);
+	mark_basic_block_alloc(&arena->basic_block);
+	mark_multijmp_alloc(&arena->multijmp);
+	mark_entrypoint_alloc(&arena->entrypoint);
+	mark_asm_rules_alloc(&arena->asm_rules);
+	mark_asm_constraint_alloc(&arena->asm_constraint);
+}
+
+static void rollback_ir_arena(struct ir_arena *arena)
+{
+	rollback_ptrlist_alloc(&arena->ptrlist);
+	rollback_pseudo_alloc(&arena->pseudo);
+	rollback_pseudo_user_alloc(&arena->pseudo_user);
+	rollback_instruction_alloc(&arena->instruction);
+	rollback_basic_block_alloc(&arena->basic_block);
+	rollback_multijmp_alloc(&arena->multijmp);
+	rollback_entrypoint_alloc(&arena->entrypoint);
+	rollback_asm_rules_alloc(&arena->asm_rules);
+	rollback_asm_constraint_alloc(&arena->asm_constraint);
+}
+
+/*
+ * Drop the IR of a function once the caller is done with it.
+ *
+ * Everything allocated since the function was linearized goes,
+ * so this must be the most recently linearized entrypoint, and
+ * nothing that has to outlive it may have been allocated from
+ * the IR allocators (or ptr lists) in the meantime. Tools that
+ * need the IR for longer simply never call this.
+ */
+void free_entrypoint(struct entrypoint *ep)
+{
+	struct ir_arena arena = ep->arena;
+
+	ep->name->ep = NULL;
+	clear_shared_pseudos();
+	rollback_ir_arena(&arena);
+}
+
 static struct entrypoint *linearize_fn(struct symbol *sym, struct symbol *base_type)
 {
+	struct ir_arena arena;
 	struct entrypoint *ep;
 	struct basic_block *bb;
 	struct symbol *arg;
@@ -2129,7 +2417,9 @@ static struct entrypoint *linearize_fn(struct symbol *sym, struct symbol *base_t
 	if (!base_type->stmt)
 		return NULL;
 
+	mark_ir_arena(&arena);
 	ep = alloc_entrypoint();
+	ep->arena = arena;
 	bb = alloc_basic_block(ep, sym->pos);
 	
 	ep->name = sym;
@@ -2162,31 +2452,40 @@ static struct entrypoint *linearize_fn(struct symbol *sym, struct symbol *base_t
 	 * Do trivial flow simplification - branches to
 	 * branches, kill dead basicblocks etc
 	 */
-	kill_unreachable_bbs(ep);
+	run_pass(ep, PASS_UNREACHABLE);
 
 	/*
 	 * Turn symbols into pseudos
 	 */
-	simplify_symbol_usage(ep);
+	run_pass(ep, PASS_SYMBOLS);
 
 repeat:
+	/*
+	 * Fold what is constant, and drop the branches
+	 * that can't be taken because of it. This runs
+	 * once before the CSE loop, and again only when
+	 * the flow simplification below starts over.
+	 */
+	run_pass(ep, PASS_SCCP);
+
 	/*
 	 * Remove trivial instructions, and try to CSE
 	 * the rest.
 	 */
 	do {
-		cleanup_and_cse(ep);
-		pack_basic_blocks(ep);
+		repeat_phase = 0;
+		run_pass(ep, PASS_CSE);
+		run_pass(ep, PASS_PACK);
 	} while (repeat_phase & REPEAT_CSE);
 
-	kill_unreachable_bbs(ep);
+	run_pass(ep, PASS_UNREACHABLE);
 	vrfy_flow(ep);
 
 	/* Cleanup */
 	clear_symbol_pseudos(ep);
 
 	/* And track pseudo register usage */
-	track_pseudo_liveness(ep);
+	run_pass(ep, PASS_LIVENESS);
 
 	/*
 	 * Some flow optimizations can only effectively
@@ -2194,15 +2493,16 @@ repeat:
 	 * if they trigger, we need to start all over
 	 * again
 	 */
-	if (simplify_flow(ep)) {
+	if (run_pass(ep, PASS_FLOW)) {
 		clear_liveness(ep);
 		goto repeat;
 	}
 
 	/* Finally, add deathnotes to pseudos now that we have them */
 	if (dbg_dead)
-		track_pseudo_death(ep);
+		run_pass(ep, PASS_DEATH);
 
+	show_pass_stats(ep);
 	return ep;
 }
 
@@ -2216,7 +2516,12 @@ struct entrypoint *linearize_symbol(struct symbol *sym)
 	base_type = sym->ctype.base_type;
 	if (!base_type)
 		return NULL;
-	if (base_type->type == SYM_FN)
-		return linearize_fn(sym, base_type);
+	if (base_type->type == SYM_FN) {
+		enum alloc_phase phase = set_alloc_phase(ALLOC_PHASE_LINEARIZE);
+		struct entrypoint *ep = linearize_fn(sym, base_type);
+
+		set_alloc_phase(phase);
+		return ep;
+	}
 	return NULL;
 }
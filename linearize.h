@@ -10,13 +10,22 @@
 struct instruction;
 DECLARE_PTR_LIST(pseudo_ptr_list, pseudo_t);
 
+/*
+ * A use of a pseudo. The uses of a pseudo are chained through
+ * these (the first one's "prev" is the last one), and so are the
+ * uses made by an instruction, so that one can be found from the
+ * instruction and unlinked without walking all the uses of a
+ * pseudo.
+ */
 struct pseudo_user {
 	struct instruction *insn;
 	pseudo_t *userp;
+	pseudo_t pseudo;			/* whose use it is */
+	struct pseudo_user *next, *prev;	/* on pseudo->users */
+	struct pseudo_user *next_use;		/* on insn->uses */
 };
 
 DECLARE_ALLOCATOR(pseudo_user);
-DECLARE_PTR_LIST(pseudo_user_list, struct pseudo_user);
 
 
 enum pseudo_type {
@@ -31,7 +40,7 @@ enum pseudo_type {
 struct pseudo {
 	int nr;
 	enum pseudo_type type;
-	struct pseudo_user_list *users;
+	struct pseudo_user *users;
 	struct ident *ident;
 	union {
 		struct symbol *sym;
@@ -50,6 +59,16 @@ struct multijmp {
 	int begin, end;
 };
 
+/*
+ * How the cases of a switch are spread out, for a backend to choose
+ * between a jump table and a tree of compares (see switch_is_dense()).
+ */
+struct switch_info {
+	int nr;				/* cases, not counting the default */
+	long long low, high;		/* the smallest and biggest case value */
+	struct basic_block *def;
+};
+
 struct asm_constraint {
 	pseudo_t pseudo;
 	const char *constraint;
@@ -73,6 +92,7 @@ struct instruction {
 	struct basic_block *bb;
 	struct position pos;
 	struct symbol *type;
+	struct pseudo_user *uses;
 	union {
 		pseudo_t target;
 		pseudo_t cond;		/* for branch and switch */
@@ -109,7 +129,7 @@ struct instruction {
 		struct /* multijump */ {
 			int begin, end;
 		};
-		struct /* setval */ {
+		struct /* setval and init */ {
 			pseudo_t symbol;		/* Subtle: same offset as "src" !! */
 			struct expression *val;
 		};
@@ -191,6 +211,7 @@ enum opcode {
 	OP_ALLOCA,
 	OP_LOAD,
 	OP_STORE,
+	OP_INIT,
 	OP_SETVAL,
 	OP_SYMADDR,
 	OP_GET_ELEMENT_PTR,
@@ -226,6 +247,7 @@ struct instruction_list;
 
 struct basic_block {
 	struct position pos;
+	int nr;			/* for the label when shown */
 	unsigned long generation;
 	int context;
 	struct entrypoint *ep;
@@ -233,6 +255,14 @@ struct basic_block {
 	struct basic_block_list *children; /* destinations */
 	struct instruction_list *insns;	/* Linear list of instructions */
 	struct pseudo_list *needs, *defines;
+	/* the same as bitmaps, while liveness.c works on them */
+	unsigned long *needs_set, *defines_set;
+	/* the dominator tree, see dominate.c */
+	struct basic_block *idom;
+	struct basic_block_list *doms;	/* immediately dominated bbs */
+	struct basic_block_list *df;	/* dominance frontier */
+	int postorder_nr, dom_level;
+	unsigned int dom_pre, dom_post;
 	void *priv;
 };
 
@@ -243,17 +273,21 @@ static inline int is_branch_goto(struct instruction *br)
 
 static inline void add_bb(struct basic_block_list **list, struct basic_block *bb)
 {
-	add_ptr_list(list, bb);
+	add_ptr_vec(list, bb);
 }
 
 static inline void add_instruction(struct instruction_list **list, struct instruction *insn)
 {
-	add_ptr_list(list, insn);
+	add_ptr_vec(list, insn);
 }
 
+/*
+ * A switch's cases are kept as a vector, sorted (the default last),
+ * so that switch_lookup() can do a binary search in it.
+ */
 static inline void add_multijmp(struct multijmp_list **list, struct multijmp *multijmp)
 {
-	add_ptr_list(list, multijmp);
+	add_ptr_vec(list, multijmp);
 }
 
 static inline pseudo_t *add_pseudo(struct pseudo_list **list, pseudo_t pseudo)
@@ -286,21 +320,95 @@ static inline void add_pseudo_ptr(pseudo_t *ptr, struct pseudo_ptr_list **list)
 	add_ptr_list(list, ptr);
 }
 
-static inline void add_pseudo_user_ptr(struct pseudo_user *user, struct pseudo_user_list **list)
-{
-	add_ptr_list(list, user);
-}
+/*
+ * Walk the uses of a pseudo. The current one may be unlinked
+ * on the way.
+ */
+#define FOR_EACH_USER(pseudo, pu) do {					\
+	struct pseudo_user *__next_user;				\
+	for (pu = (pseudo)->users; pu; pu = __next_user) {		\
+		__next_user = pu->next;
+
+#define FOR_EACH_USER_REVERSE(pseudo, pu) do {				\
+	struct pseudo_user *__prev_user;				\
+	for (pu = (pseudo)->users ? (pseudo)->users->prev : NULL; pu; pu = __prev_user) { \
+		__prev_user = pu == (pseudo)->users ? NULL : pu->prev;
+
+#define END_FOR_EACH_USER(pu)						\
+	}								\
+} while (0)
+
+#define END_FOR_EACH_USER_REVERSE(pu) END_FOR_EACH_USER(pu)
 
 static inline int has_use_list(pseudo_t p)
 {
 	return (p && p->type != PSEUDO_VOID && p->type != PSEUDO_VAL);
 }
 
+static inline int has_one_user(pseudo_t p)
+{
+	return p->users && !p->users->next;
+}
+
+static inline void add_pseudo_user(struct pseudo_user *user, pseudo_t p)
+{
+	struct pseudo_user *first = p->users;
+
+	user->pseudo = p;
+	user->next = NULL;
+	if (!first) {
+		user->prev = user;
+		p->users = user;
+		return;
+	}
+	user->prev = first->prev;
+	first->prev->next = user;
+	first->prev = user;
+}
+
+static inline void unlink_pseudo_user(struct pseudo_user *user)
+{
+	pseudo_t p = user->pseudo;
+	struct pseudo_user *first = p->users;
+
+	if (user == first)
+		p->users = user->next;
+	else
+		user->prev->next = user->next;
+	if (user->next)
+		user->next->prev = user->prev;
+	else if (p->users)
+		p->users->prev = user->prev;
+	user->pseudo = NULL;
+}
+
+/* Hand all the uses of "src" over to "dst" */
+static inline void move_pseudo_users(pseudo_t src, pseudo_t dst)
+{
+	struct pseudo_user *first = src->users, *last, *pu;
+
+	if (!first)
+		return;
+	for (pu = first; pu; pu = pu->next)
+		pu->pseudo = dst;
+	last = first->prev;
+	src->users = NULL;
+	if (!dst->users) {
+		dst->users = first;
+		return;
+	}
+	first->prev = dst->users->prev;
+	dst->users->prev->next = first;
+	dst->users->prev = last;
+}
+
 static inline struct pseudo_user *alloc_pseudo_user(struct instruction *insn, pseudo_t *pp)
 {
 	struct pseudo_user *user = __alloc_pseudo_user(0);
 	user->userp = pp;
 	user->insn = insn;
+	user->next_use = insn->uses;
+	insn->uses = user;
 	return user;
 }
 
@@ -308,7 +416,7 @@ static inline void use_pseudo(struct instruction *insn, pseudo_t p, pseudo_t *pp
 {
 	*pp = p;
 	if (has_use_list(p))
-		add_pseudo_user_ptr(alloc_pseudo_user(insn, pp), &p->users);
+		add_pseudo_user(alloc_pseudo_user(insn, pp), p);
 }
 
 static inline void remove_bb_from_list(struct basic_block_list **list, struct basic_block *entry, int count)
@@ -322,6 +430,22 @@ static inline void replace_bb_in_list(struct basic_block_list **list,
 	replace_ptr_list_entry((struct ptr_list **)list, old, new, count);
 }
 
+/*
+ * Where the IR allocators stood when a function was linearized,
+ * so that free_entrypoint() can drop it all in one go.
+ */
+struct ir_arena {
+	struct allocator_mark ptrlist;
+	struct allocator_mark pseudo;
+	struct allocator_mark pseudo_user;
+	struct allocator_mark instruction;
+	struct allocator_mark basic_block;
+	struct allocator_mark multijmp;
+	struct allocator_mark entrypoint;
+	struct allocator_mark asm_rules;
+	struct allocator_mark asm_constraint;
+};
+
 struct entrypoint {
 	struct symbol *name;
 	struct symbol_list *syms;
@@ -329,16 +453,60 @@ struct entrypoint {
 	struct basic_block_list *bbs;
 	struct basic_block *active;
 	struct instruction *entry;
+	struct ir_arena arena;
+	unsigned int dom_valid:1, df_valid:1;
 };
 
+/*
+ * Does "dom" dominate "bb"? Nothing reachable is dominated by
+ * an unreachable bb, and an unreachable one by everything.
+ */
+static inline int bb_dominates(struct basic_block *dom, struct basic_block *bb)
+{
+	if (!bb->dom_pre)
+		return 1;
+	return dom->dom_pre <= bb->dom_pre && bb->dom_post <= dom->dom_post;
+}
+
+/* The edges of "bb" changed: the dominator tree needs rebuilding */
+static inline void cfg_changed(struct basic_block *bb)
+{
+	if (bb->ep)
+		bb->ep->dom_valid = 0;
+}
+
 extern void insert_select(struct basic_block *bb, struct instruction *br, struct instruction *phi, pseudo_t if_true, pseudo_t if_false);
 extern void insert_branch(struct basic_block *bb, struct instruction *br, struct basic_block *target);
 
 pseudo_t alloc_phi(struct basic_block *source, pseudo_t pseudo, int size);
+struct instruction *insert_phi_node(struct basic_block *bb, int size);
 pseudo_t alloc_pseudo(struct instruction *def);
 pseudo_t value_pseudo(long long val);
+void clear_shared_pseudos(void);
+
+extern struct basic_block *switch_lookup(struct instruction *insn, long long val);
+extern void get_switch_info(struct instruction *insn, struct switch_info *info);
+
+extern int bulk_initializer(struct symbol *sym);
+extern int initializer_bytes(struct expression *init, unsigned char *buf, unsigned int size);
+extern void show_initializer_bytes(const unsigned char *data, unsigned int size);
+
+#define MAX_SWITCH_TABLE	4096
+
+/*
+ * Worth a jump table: enough cases, at least one for 40% of its
+ * entries, and not too big. A range only counts as one case, it
+ * is cheaper as a pair of compares than as many entries.
+ */
+static inline int switch_is_dense(struct switch_info *info)
+{
+	long long entries = info->high - info->low + 1;
+
+	return info->nr >= 4 && entries <= MAX_SWITCH_TABLE && info->nr * 10LL >= 4 * entries;
+}
 
 struct entrypoint *linearize_symbol(struct symbol *sym);
+void free_entrypoint(struct entrypoint *ep);
 int unssa(struct entrypoint *ep);
 void show_entry(struct entrypoint *ep);
 const char *show_pseudo(pseudo_t pseudo);
@@ -6,11 +6,15 @@
  */
 
 #include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "parse.h"
 #include "expression.h"
 #include "linearize.h"
 #include "flow.h"
+#include "bitmap.h"
 
 static void phi_defines(struct instruction * phi_node, pseudo_t target,
 	void (*defines)(struct basic_block *, struct instruction *, pseudo_t))
@@ -92,6 +96,10 @@ static void track_instruction_usage(struct basic_block *bb, struct instruction *
 		USES(src); USES(target);
 		break;
 
+	case OP_INIT:
+		USES(src);
+		break;
+
 	case OP_SETVAL:
 		DEFINES(target);
 		break;
@@ -169,19 +177,103 @@ int pseudo_in_list(struct pseudo_list *list, pseudo_t pseudo)
 	return 0;
 }
 
-static int liveness_changed;
+static inline int trackable_pseudo(pseudo_t pseudo)
+{
+	return pseudo && (pseudo->type == PSEUDO_REG || pseudo->type == PSEUDO_ARG);
+}
 
-static void add_pseudo_exclusive(struct pseudo_list **list, pseudo_t pseudo)
+/*
+ * The lists of pseudos a bb needs and defines are shadowed by
+ * bitmaps while we work on them, so that membership is a bit
+ * test rather than a walk of the list. A function's registers
+ * are numbered consecutively, so a bitmap has one bit for each
+ * argument, followed by one for each register from the lowest
+ * numbered one used.
+ */
+static int set_args, set_base, set_top;
+static int set_words;
+static pseudo_t *set_pseudos;
+
+static void size_pseudo(struct basic_block *bb, struct instruction *insn, pseudo_t pseudo)
 {
-	if (!pseudo_in_list(*list, pseudo)) {
-		liveness_changed = 1;
-		add_pseudo(list, pseudo);
+	if (!trackable_pseudo(pseudo))
+		return;
+	if (pseudo->type == PSEUDO_ARG) {
+		if (pseudo->nr > set_args)
+			set_args = pseudo->nr;
+		return;
 	}
+	if (pseudo->nr < set_base)
+		set_base = pseudo->nr;
+	if (pseudo->nr > set_top)
+		set_top = pseudo->nr;
 }
 
-static inline int trackable_pseudo(pseudo_t pseudo)
+static void size_pseudo_sets(struct entrypoint *ep)
 {
-	return pseudo && (pseudo->type == PSEUDO_REG || pseudo->type == PSEUDO_ARG);
+	struct basic_block *bb;
+
+	set_args = 0;
+	set_base = INT_MAX;
+	set_top = 0;
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *insn;
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (insn->bb)
+				track_instruction_usage(bb, insn, size_pseudo, size_pseudo);
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(bb);
+	if (set_top < set_base)
+		set_base = set_top = 0;
+	set_words = (set_args + set_top - set_base + BITS_IN_LONG) / BITS_IN_LONG;
+}
+
+static void *alloc_liveness(int nr, int size)
+{
+	void *ptr = calloc(nr, size);
+
+	if (!ptr)
+		die("out of memory");
+	return ptr;
+}
+
+static unsigned long *alloc_pseudo_sets(int nr)
+{
+	return alloc_liveness(nr * set_words, sizeof(unsigned long));
+}
+
+static inline int pseudo_index(pseudo_t pseudo)
+{
+	int i = set_args + pseudo->nr - set_base;
+
+	if (pseudo->type == PSEUDO_ARG)
+		i = pseudo->nr - 1;
+	assert(i >= 0 && i < set_words * BITS_IN_LONG);
+	return i;
+}
+
+static inline int pseudo_in_set(unsigned long *set, pseudo_t pseudo)
+{
+	return test_bit(pseudo_index(pseudo), set);
+}
+
+static inline int add_pseudo_set(unsigned long *set, pseudo_t pseudo)
+{
+	int i = pseudo_index(pseudo);
+
+	if (set_pseudos)
+		set_pseudos[i] = pseudo;
+	return !test_and_set_bit(i, set);
+}
+
+static int liveness_changed;
+
+static void add_pseudo_exclusive(struct pseudo_list **list, unsigned long *set, pseudo_t pseudo)
+{
+	if (add_pseudo_set(set, pseudo)) {
+		liveness_changed = 1;
+		add_pseudo(list, pseudo);
+	}
 }
 
 static void insn_uses(struct basic_block *bb, struct instruction *insn, pseudo_t pseudo)
@@ -189,7 +281,7 @@ static void insn_uses(struct basic_block *bb, struct instruction *insn, pseudo_t
 	if (trackable_pseudo(pseudo)) {
 		struct instruction *def = pseudo->def;
 		if (pseudo->type != PSEUDO_REG || def->bb != bb || def->opcode == OP_PHI)
-			add_pseudo_exclusive(&bb->needs, pseudo);
+			add_pseudo_exclusive(&bb->needs, bb->needs_set, pseudo);
 	}
 }
 
@@ -197,6 +289,7 @@ static void insn_defines(struct basic_block *bb, struct instruction *insn, pseud
 {
 	assert(trackable_pseudo(pseudo));
 	add_pseudo(&bb->defines, pseudo);
+	add_pseudo_set(bb->defines_set, pseudo);
 }
 
 static void track_bb_liveness(struct basic_block *bb)
@@ -206,13 +299,148 @@ static void track_bb_liveness(struct basic_block *bb)
 	FOR_EACH_PTR(bb->needs, needs) {
 		struct basic_block *parent;
 		FOR_EACH_PTR(bb->parents, parent) {
-			if (!pseudo_in_list(parent->defines, needs)) {
-				add_pseudo_exclusive(&parent->needs, needs);
+			if (!pseudo_in_set(parent->defines_set, needs)) {
+				add_pseudo_exclusive(&parent->needs, parent->needs_set, needs);
 			}
 		} END_FOR_EACH_PTR(parent);
 	} END_FOR_EACH_PTR(needs);
 }
 
+/*
+ * The original solver: push what each bb needs up to its parents,
+ * and go over all the bbs again until nothing changes. It's kept
+ * for comparison, see validation/bench-liveness.
+ */
+static void iterate_liveness(struct entrypoint *ep)
+{
+	struct basic_block *bb;
+
+	do {
+		liveness_changed = 0;
+		FOR_EACH_PTR_REVERSE(ep->bbs, bb) {
+			track_bb_liveness(bb);
+		} END_FOR_EACH_PTR_REVERSE(bb);
+	} while (liveness_changed);
+}
+
+/*
+ * What the children of a bb need: the pseudos live on its way out.
+ */
+static void live_out(struct basic_block *bb, unsigned long *out)
+{
+	struct basic_block *child;
+	int i;
+
+	memset(out, 0, set_words * sizeof(unsigned long));
+	FOR_EACH_PTR(bb->children, child) {
+		unsigned long *in = child->needs_set;
+		if (!in)
+			continue;
+		for (i = 0; i < set_words; i++)
+			out[i] |= in[i];
+	} END_FOR_EACH_PTR(child);
+}
+
+/*
+ * The bbs in postorder (children before their parents), which is
+ * the order a backwards problem converges fastest in. Only the bbs
+ * of this entrypoint have sets: a goto to an undeclared label can
+ * leave a child outside of ep->bbs.
+ */
+static int postorder_bbs(struct entrypoint *ep, struct basic_block **order, int nr, int edges)
+{
+	struct basic_block **stack = alloc_liveness(2 * nr + edges, sizeof(*stack));
+	unsigned long generation = ++bb_generation;
+	struct basic_block *bb;
+	int top = 0, n = 0;
+
+	FOR_EACH_PTR_REVERSE(ep->bbs, bb) {
+		stack[top++] = bb;
+	} END_FOR_EACH_PTR_REVERSE(bb);
+	while (top) {
+		struct basic_block *child;
+
+		bb = stack[--top];
+		if ((unsigned long)bb & 1) {
+			order[n++] = (void *)((unsigned long)bb & ~1UL);
+			continue;
+		}
+		if (bb->generation == generation)
+			continue;
+		bb->generation = generation;
+		stack[top++] = (void *)((unsigned long)bb | 1);
+		FOR_EACH_PTR_REVERSE(bb->children, child) {
+			if (child->needs_set && child->generation != generation)
+				stack[top++] = child;
+		} END_FOR_EACH_PTR_REVERSE(child);
+	}
+	free(stack);
+	return n;
+}
+
+/*
+ * A bb needs what it uses before defining it, and what its
+ * children need that it doesn't define itself. Solve that with a
+ * worklist: whenever what a bb needs grows, its parents have to
+ * be looked at again. The set operations work a word at a time.
+ */
+static void solve_liveness(struct entrypoint *ep, int nr, int edges, unsigned long *sets)
+{
+	struct basic_block **queue = alloc_liveness(nr, sizeof(*queue));
+	unsigned char *queued = alloc_liveness(nr, 1);
+	unsigned long *out = alloc_pseudo_sets(2);
+	unsigned long *new = out + set_words;
+	int head = 0, count, i;
+
+	count = postorder_bbs(ep, queue, nr, edges);
+	for (i = 0; i < count; i++)
+		queued[(queue[i]->needs_set - sets) / (2 * set_words)] = 1;
+
+	while (count) {
+		struct basic_block *bb = queue[head];
+		unsigned long *in = bb->needs_set, *kill = bb->defines_set;
+		struct basic_block *parent;
+		unsigned long changed = 0;
+
+		head = (head + 1) % nr;
+		count--;
+		queued[(in - sets) / (2 * set_words)] = 0;
+
+		live_out(bb, out);
+		for (i = 0; i < set_words; i++) {
+			new[i] = out[i] & ~kill[i] & ~in[i];
+			changed |= new[i];
+		}
+		if (!changed)
+			continue;
+
+		for (i = 0; i < set_words; i++) {
+			unsigned long bits = new[i];
+
+			in[i] |= bits;
+			while (bits) {
+				int bit = __builtin_ctzl(bits);
+				add_pseudo(&bb->needs, set_pseudos[i * BITS_IN_LONG + bit]);
+				bits &= bits - 1;
+			}
+		}
+
+		FOR_EACH_PTR(bb->parents, parent) {
+			int n;
+			if (!parent->needs_set)
+				continue;
+			n = (parent->needs_set - sets) / (2 * set_words);
+			if (queued[n])
+				continue;
+			queued[n] = 1;
+			queue[(head + count++) % nr] = parent;
+		} END_FOR_EACH_PTR(parent);
+	}
+	free(out);
+	free(queued);
+	free(queue);
+}
+
 /*
  * We need to clear the liveness information if we 
  * are going to re-run it.
@@ -234,6 +462,18 @@ void clear_liveness(struct entrypoint *ep)
 void track_pseudo_liveness(struct entrypoint *ep)
 {
 	struct basic_block *bb;
+	unsigned long *sets, *out;
+	int nr = ptr_list_size((struct ptr_list *)ep->bbs);
+	int i = 0, edges = 0;
+
+	size_pseudo_sets(ep);
+	sets = alloc_pseudo_sets(2 * nr);
+	set_pseudos = alloc_liveness(set_words * BITS_IN_LONG, sizeof(pseudo_t));
+	FOR_EACH_PTR(ep->bbs, bb) {
+		bb->needs_set = sets + i++ * set_words;
+		bb->defines_set = sets + i++ * set_words;
+		edges += ptr_list_size((struct ptr_list *)bb->children);
+	} END_FOR_EACH_PTR(bb);
 
 	/* Add all the bb pseudo usage */
 	FOR_EACH_PTR(ep->bbs, bb) {
@@ -247,35 +487,39 @@ void track_pseudo_liveness(struct entrypoint *ep)
 	} END_FOR_EACH_PTR(bb);
 
 	/* Calculate liveness.. */
-	do {
-		liveness_changed = 0;
-		FOR_EACH_PTR_REVERSE(ep->bbs, bb) {
-			track_bb_liveness(bb);
-		} END_FOR_EACH_PTR_REVERSE(bb);
-	} while (liveness_changed);
+	if (dbg_liveness_iterate)
+		iterate_liveness(ep);
+	else
+		solve_liveness(ep, nr, edges, sets);
 
 	/* Remove the pseudos from the "defines" list that are used internally */
+	out = alloc_pseudo_sets(1);
 	FOR_EACH_PTR(ep->bbs, bb) {
 		pseudo_t def;
+		live_out(bb, out);
 		FOR_EACH_PTR(bb->defines, def) {
-			struct basic_block *child;
-			FOR_EACH_PTR(bb->children, child) {
-				if (pseudo_in_list(child->needs, def))
-					goto is_used;
-			} END_FOR_EACH_PTR(child);
-			DELETE_CURRENT_PTR(def);
-is_used:
-		;
+			if (!pseudo_in_set(out, def))
+				DELETE_CURRENT_PTR(def);
 		} END_FOR_EACH_PTR(def);
 		PACK_PTR_LIST(&bb->defines);
 	} END_FOR_EACH_PTR(bb);
+	free(out);
+
+	/* From here on the lists are all there is */
+	FOR_EACH_PTR(ep->bbs, bb) {
+		bb->needs_set = NULL;
+		bb->defines_set = NULL;
+	} END_FOR_EACH_PTR(bb);
+	free(set_pseudos);
+	set_pseudos = NULL;
+	free(sets);
 }
 
-static void merge_pseudo_list(struct pseudo_list *src, struct pseudo_list **dest)
+static void merge_pseudo_list(struct pseudo_list *src, struct pseudo_list **dest, unsigned long *set)
 {
 	pseudo_t pseudo;
 	FOR_EACH_PTR(src, pseudo) {
-		add_pseudo_exclusive(dest, pseudo);
+		add_pseudo_exclusive(dest, set, pseudo);
 	} END_FOR_EACH_PTR(pseudo);
 }
 
@@ -302,6 +546,7 @@ static void track_bb_phi_uses(struct basic_block *bb)
 }
 
 static struct pseudo_list **live_list;
+static unsigned long *live_set;
 static struct pseudo_list *dead_list;
 
 static void death_def(struct basic_block *bb, struct instruction *insn, pseudo_t pseudo)
@@ -310,7 +555,7 @@ static void death_def(struct basic_block *bb, struct instruction *insn, pseudo_t
 
 static void death_use(struct basic_block *bb, struct instruction *insn, pseudo_t pseudo)
 {
-	if (trackable_pseudo(pseudo) && !pseudo_in_list(*live_list, pseudo)) {
+	if (trackable_pseudo(pseudo) && add_pseudo_set(live_set, pseudo)) {
 		add_pseudo(&dead_list, pseudo);
 		add_pseudo(live_list, pseudo);
 	}
@@ -322,8 +567,9 @@ static void track_pseudo_death_bb(struct basic_block *bb)
 	struct basic_block *child;
 	struct instruction *insn;
 
+	memset(live_set, 0, set_words * sizeof(unsigned long));
 	FOR_EACH_PTR(bb->children, child) {
-		merge_pseudo_list(child->needs, &live);
+		merge_pseudo_list(child->needs, &live, live_set);
 	} END_FOR_EACH_PTR(child);
 
 	live_list = &live;
@@ -356,7 +602,11 @@ void track_pseudo_death(struct entrypoint *ep)
 		track_bb_phi_uses(bb);
 	} END_FOR_EACH_PTR(bb);
 
+	size_pseudo_sets(ep);
+	live_set = alloc_pseudo_sets(1);
 	FOR_EACH_PTR(ep->bbs, bb) {
 		track_pseudo_death_bb(bb);
 	} END_FOR_EACH_PTR(bb);
+	free(live_set);
+	live_set = NULL;
 }
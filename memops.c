@@ -2,6 +2,27 @@
  * memops - try to combine memory ops.
  *
  * Copyright (C) 2004 Linus Torvalds
+ *
+ * The loads and stores are taken one by one going down the dominator
+ * tree, with a small memory SSA to know when an earlier access is
+ * still good. The accesses through the same address pseudo form a
+ * group, and what a group can alias is described by the "memory
+ * variables" a store to it changes and a value loaded from it
+ * depends on:
+ *
+ *  - two different symbols never alias, and a local whose address
+ *    isn't taken doesn't alias anything else,
+ *  - a pointer only points into its own address space,
+ *  - a pointer derived from a restrict argument which doesn't
+ *    escape only aliases pointers derived from the same argument,
+ *  - with -fstrict-aliasing, pointers to different struct types
+ *    don't alias, unless one of the structs contains the other.
+ *
+ * Each variable has a version that changes with each store to it,
+ * and gets a new one at the phi-nodes it would need (the iterated
+ * dominance frontier of those stores). A value stored or loaded is
+ * available to a later load of the same place as long as none of
+ * the variables it depends on got a new version since.
  */
 
 #include <string.h>
@@ -16,9 +37,521 @@
 #include "linearize.h"
 #include "flow.h"
 
-static int find_dominating_parents(pseudo_t pseudo, struct instruction *insn,
+enum mem_kind {
+	MEM_OWN,		/* stores through the group's address */
+	MEM_SYM,		/* stores to symbols of a type */
+	MEM_SYM_ANY,		/* stores to any symbol */
+	MEM_PTR,		/* stores through pointers to a type */
+	MEM_PTR_ANY,		/* stores through any pointer */
+	MEM_RESTRICT,		/* stores based on a restrict argument */
+	MEM_UNKNOWN,		/* stores through pointers we know nothing about */
+	MEM_ALL,		/* any store that isn't to a local */
+	MEM_CALL,		/* calls */
+};
+
+struct mem_var {
+	enum mem_kind kind;
+	unsigned int as;
+	struct symbol *type;		/* struct type, NULL for everything else */
+	pseudo_t base;			/* restrict argument */
+	int escapes;
+
+	unsigned int version;		/* seq << 1, | 1 for a phi-node */
+	unsigned int read, other_read;	/* last loads depending on it */
+	struct mem_group *reader;
+
+	struct basic_block *last_def;
+	struct basic_block_list *defs;
+	struct mem_var *next;
+};
+
+DECLARE_PTR_LIST(mem_var_list, struct mem_var);
+
+/* A value that can be had without loading it */
+struct mem_entry {
+	struct mem_entry *next;
+	struct instruction *insn;
+	unsigned int offset, size;
+	pseudo_t value;
+	unsigned int seq;
+	unsigned int dead;
+};
+
+struct mem_group {
+	pseudo_t addr;
+	int local;
+	struct mem_var own;
+	struct mem_var **deps, **clobbers;
+	int nr_deps, nr_clobbers;
+	struct mem_entry *entries;
+
+	struct basic_block *pending_bb;	/* stores not read yet, in pending_bb */
+	struct mem_entry *pending;
+	struct mem_group *next;
+};
+
+/* A load to replace once we're done looking */
+struct mem_forward {
+	struct instruction *insn;
+	pseudo_t value;
+};
+
+/* Things to put back when leaving a part of the dominator tree */
+struct mem_undo {
+	unsigned int *slot;
+	unsigned int old;
+	struct mem_group *group;	/* or drop its first entry */
+};
+
+#define MAX_TYPES	16
+#define MAX_VARS	(2 * MAX_TYPES + 8)
+
+/* How many instructions to look at, going back from a load */
+#define SEARCH_LIMIT	1024
+
+static struct mem_var *mem_vars;
+static struct mem_group *mem_groups;
+static struct mem_var *call_var;
+static unsigned int mem_seq;
+static int nr_vars;
+
+static struct mem_undo *undo_log;
+static int undo_nr, undo_size;
+
+static struct mem_forward *forwards;
+static int forward_nr, forward_size;
+static struct instruction_list *searches;
+static int search_left;
+
+/* Entries are only freed in undo_to(), keep them for the next load */
+static struct mem_entry *free_entries;
+
+static void *alloc_mem(int nr, int size)
+{
+	void *ptr = calloc(nr, size);
+
+	if (!ptr)
+		die("out of memory");
+	return ptr;
+}
+
+static void set_slot(unsigned int *slot, unsigned int val)
+{
+	if (undo_nr == undo_size) {
+		undo_size = undo_size ? undo_size * 2 : 256;
+		undo_log = realloc(undo_log, undo_size * sizeof(*undo_log));
+		if (!undo_log)
+			die("out of memory");
+	}
+	undo_log[undo_nr].slot = slot;
+	undo_log[undo_nr].old = *slot;
+	undo_log[undo_nr].group = NULL;
+	undo_nr++;
+	*slot = val;
+}
+
+static void forward_load(struct instruction *insn, pseudo_t value)
+{
+	if (forward_nr == forward_size) {
+		forward_size = forward_size ? forward_size * 2 : 64;
+		forwards = realloc(forwards, forward_size * sizeof(*forwards));
+		if (!forwards)
+			die("out of memory");
+	}
+	forwards[forward_nr].insn = insn;
+	forwards[forward_nr].value = value;
+	forward_nr++;
+}
+
+static void add_entry(struct mem_group *group, struct instruction *insn, pseudo_t value)
+{
+	struct mem_entry *entry = free_entries;
+
+	if (entry)
+		free_entries = entry->next;
+	else
+		entry = alloc_mem(1, sizeof(*entry));
+	entry->insn = insn;
+	entry->offset = insn->offset;
+	entry->size = insn->size;
+	entry->value = value;
+	entry->seq = mem_seq;
+	entry->next = group->entries;
+	group->entries = entry;
+
+	set_slot(&entry->dead, 0);
+	undo_log[undo_nr - 1].group = group;
+}
+
+static void undo_to(int mark)
+{
+	while (undo_nr > mark) {
+		struct mem_undo *undo = &undo_log[--undo_nr];
+		struct mem_group *group = undo->group;
+
+		if (group) {
+			struct mem_entry *entry = group->entries;
+			group->entries = entry->next;
+			entry->next = free_entries;
+			free_entries = entry;
+			continue;
+		}
+		*undo->slot = undo->old;
+	}
+}
+
+static struct mem_var *new_var(enum mem_kind kind)
+{
+	struct mem_var *var = alloc_mem(1, sizeof(*var));
+
+	var->kind = kind;
+	var->next = mem_vars;
+	mem_vars = var;
+	return var;
+}
+
+static struct mem_var *find_var(enum mem_kind kind, unsigned int as, struct symbol *type, pseudo_t base)
+{
+	struct mem_var *var;
+
+	for (var = mem_vars; var; var = var->next) {
+		if (var->kind == kind && var->as == as && var->type == type && var->base == base)
+			return var;
+	}
+	var = new_var(kind);
+	var->as = as;
+	var->type = type;
+	var->base = base;
+	return var;
+}
+
+static int address_taken(pseudo_t pseudo)
+{
+	struct pseudo_user *pu;
+	FOR_EACH_USER(pseudo, pu) {
+		struct instruction *insn = pu->insn;
+		if (!insn->bb)
+			continue;
+		if (insn->opcode != OP_LOAD && insn->opcode != OP_STORE && insn->opcode != OP_INIT)
+			return 1;
+	} END_FOR_EACH_USER(pu);
+	return 0;
+}
+
+static int local_pseudo(pseudo_t pseudo)
+{
+	return pseudo->type == PSEUDO_SYM
+		&& !(pseudo->sym->ctype.modifiers & (MOD_STATIC | MOD_NONLOCAL))
+		&& !address_taken(pseudo);
+}
+
+static struct symbol *argument_type(struct entrypoint *ep, pseudo_t arg)
+{
+	struct symbol *fn = ep->name->ctype.base_type, *sym;
+	int nr = 0;
+
+	FOR_EACH_PTR(fn->arguments, sym) {
+		if (++nr == arg->nr)
+			return sym;
+	} END_FOR_EACH_PTR(sym);
+	return NULL;
+}
+
+static struct symbol *pseudo_type(struct entrypoint *ep, pseudo_t pseudo)
+{
+	switch (pseudo->type) {
+	case PSEUDO_REG:
+		return pseudo->def ? pseudo->def->type : NULL;
+	case PSEUDO_ARG:
+		return argument_type(ep, pseudo);
+	default:
+		return NULL;
+	}
+}
+
+/* What a pointer of type "type" points to, and in which address space */
+static struct symbol *pointer_target(struct symbol *type, unsigned int *as)
+{
+	while (type && type->type == SYM_NODE)
+		type = type->ctype.base_type;
+	if (!type || type->type != SYM_PTR)
+		return NULL;
+	*as = type->ctype.as;
+	return type->ctype.base_type ? : &void_ctype;
+}
+
+static unsigned int symbol_space(struct symbol *sym)
+{
+	unsigned int as = 0;
+
+	while (sym && sym->type == SYM_NODE) {
+		as |= sym->ctype.as;
+		sym = sym->ctype.base_type;
+	}
+	return as;
+}
+
+/*
+ * The struct types an access to an object of type "type" can touch:
+ * its own and those of its members. Returns 0 if it isn't a struct
+ * or there are too many of them to bother.
+ */
+static int struct_types(struct symbol *type, struct symbol **types, int nr)
+{
+	struct symbol *member;
+	int i;
+
+	while (type && (type->type == SYM_NODE || type->type == SYM_ARRAY))
+		type = type->ctype.base_type;
+	if (!type || (type->type != SYM_STRUCT && type->type != SYM_UNION))
+		return nr;
+	for (i = 0; i < nr; i++) {
+		if (types[i] == type)
+			return nr;
+	}
+	if (nr == MAX_TYPES)
+		return -1;
+	types[nr++] = type;
+	FOR_EACH_PTR(type->symbol_list, member) {
+		nr = struct_types(member, types, nr);
+		if (nr < 0)
+			return nr;
+	} END_FOR_EACH_PTR(member);
+	return nr;
+}
+
+/*
+ * Can the value of "pseudo", derived from a restrict argument, get
+ * anywhere but the address of a load or store (or into another such
+ * pseudo)?
+ */
+static int escapes(pseudo_t pseudo, int depth)
+{
+	struct pseudo_user *pu;
+
+	if (depth > 16)
+		return 1;
+	FOR_EACH_USER(pseudo, pu) {
+		struct instruction *insn = pu->insn;
+
+		if (!insn->bb)
+			continue;
+		switch (insn->opcode) {
+		case OP_LOAD: case OP_STORE:
+			if (pu->userp != &insn->src)
+				return 1;
+			continue;
+		case OP_ADD: case OP_SUB:
+			if (pu->userp != &insn->src1)
+				return 1;
+			break;
+		case OP_CAST: case OP_SCAST: case OP_PTRCAST:
+			break;
+		case OP_BINCMP ... OP_BINCMP_END:
+			continue;
+		default:
+			return 1;
+		}
+		if (escapes(insn->target, depth + 1))
+			return 1;
+	} END_FOR_EACH_USER(pu);
+	return 0;
+}
+
+/* The restrict variable of the argument "addr" is derived from, if any */
+static struct mem_var *restrict_var(struct entrypoint *ep, pseudo_t addr)
+{
+	struct mem_var *var;
+	struct symbol *type;
+	int depth;
+
+	for (depth = 0; addr->type == PSEUDO_REG && depth < 16; depth++) {
+		struct instruction *def = addr->def;
+
+		switch (def->opcode) {
+		case OP_ADD: case OP_SUB:
+			addr = def->src1;
+			continue;
+		case OP_CAST: case OP_SCAST: case OP_PTRCAST:
+			addr = def->src;
+			continue;
+		}
+		return NULL;
+	}
+	if (addr->type != PSEUDO_ARG)
+		return NULL;
+	type = argument_type(ep, addr);
+	if (!type || !(type->ctype.modifiers & MOD_RESTRICT))
+		return NULL;
+
+	for (var = mem_vars; var; var = var->next) {
+		if (var->kind == MEM_RESTRICT && var->base == addr)
+			break;
+	}
+	if (!var) {
+		var = new_var(MEM_RESTRICT);
+		var->base = addr;
+		var->escapes = escapes(addr, 0);
+	}
+	return var->escapes ? NULL : var;
+}
+
+/*
+ * The variables for "side" (MEM_SYM or MEM_PTR) that a store to an
+ * object of type "type" changes, or that a load from one depends on.
+ */
+static int typed_vars(struct mem_var **vars, int nr, enum mem_kind side,
+	unsigned int as, struct symbol *type, int store)
+{
+	struct symbol *types[MAX_TYPES];
+	int i, nr_types = 0;
+
+	if (strict_aliasing)
+		nr_types = struct_types(type, types, 0);
+	if (nr_types <= 0) {
+		if (store)
+			vars[nr++] = find_var(side, as, NULL, NULL);
+		vars[nr++] = find_var(side + 1, as, NULL, NULL);
+		return nr;
+	}
+	for (i = 0; i < nr_types; i++)
+		vars[nr++] = find_var(side, as, types[i], NULL);
+	vars[nr++] = store ? find_var(side + 1, as, NULL, NULL) : find_var(side, as, NULL, NULL);
+	return nr;
+}
+
+static struct mem_var **copy_vars(struct mem_var **vars, int nr)
+{
+	struct mem_var **copy = alloc_mem(nr, sizeof(*copy));
+
+	memcpy(copy, vars, nr * sizeof(*copy));
+	return copy;
+}
+
+static void classify_group(struct entrypoint *ep, struct mem_group *group)
+{
+	struct mem_var *deps[MAX_VARS], *clobbers[MAX_VARS], *var;
+	int nr_deps = 0, nr_clobbers = 0;
+	pseudo_t addr = group->addr;
+	struct symbol *type;
+	unsigned int as = 0;
+
+	deps[nr_deps++] = clobbers[nr_clobbers++] = &group->own;
+	if (addr->type == PSEUDO_SYM) {
+		if (local_pseudo(addr)) {
+			group->local = 1;
+			goto done;
+		}
+		as = symbol_space(addr->sym);
+		nr_deps = typed_vars(deps, nr_deps, MEM_PTR, as, addr->sym, 0);
+		nr_clobbers = typed_vars(clobbers, nr_clobbers, MEM_SYM, as, addr->sym, 1);
+	} else if ((var = restrict_var(ep, addr)) != NULL) {
+		deps[nr_deps++] = clobbers[nr_clobbers++] = var;
+		deps[nr_deps++] = call_var;
+		goto done;
+	} else if ((type = pointer_target(pseudo_type(ep, addr), &as)) != NULL) {
+		nr_deps = typed_vars(deps, nr_deps, MEM_PTR, as, type, 0);
+		nr_deps = typed_vars(deps, nr_deps, MEM_SYM, as, type, 0);
+		nr_clobbers = typed_vars(clobbers, nr_clobbers, MEM_PTR, as, type, 1);
+	} else {
+		deps[nr_deps++] = find_var(MEM_ALL, 0, NULL, NULL);
+		clobbers[nr_clobbers++] = find_var(MEM_UNKNOWN, 0, NULL, NULL);
+	}
+	deps[nr_deps++] = find_var(MEM_UNKNOWN, 0, NULL, NULL);
+	deps[nr_deps++] = call_var;
+	clobbers[nr_clobbers++] = find_var(MEM_ALL, 0, NULL, NULL);
+done:
+	group->deps = copy_vars(deps, nr_deps);
+	group->nr_deps = nr_deps;
+	group->clobbers = copy_vars(clobbers, nr_clobbers);
+	group->nr_clobbers = nr_clobbers;
+}
+
+static struct mem_group *memop_group(struct entrypoint *ep, pseudo_t addr)
+{
+	struct mem_group *group = addr->priv;
+
+	if (group)
+		return group;
+	group = alloc_mem(1, sizeof(*group));
+	group->addr = addr;
+	group->own.kind = MEM_OWN;
+	group->next = mem_groups;
+	mem_groups = group;
+	addr->priv = group;
+	classify_group(ep, group);
+	return group;
+}
+
+/* Can a store to "store" change what a load from "load" gets? */
+static int may_alias(struct mem_group *store, struct mem_group *load)
+{
+	int i, j;
+
+	for (i = 0; i < store->nr_clobbers; i++) {
+		for (j = 0; j < load->nr_deps; j++) {
+			if (store->clobbers[i] == load->deps[j])
+				return 1;
+		}
+	}
+	return 0;
+}
+
+static int overlapping(unsigned int a_offset, unsigned int a_size,
+	unsigned int b_offset, unsigned int b_size)
+{
+	unsigned int a_start = bytes_to_bits(a_offset);
+	unsigned int b_start = bytes_to_bits(b_offset);
+
+	return a_start < b_start + b_size && b_start < a_start + a_size;
+}
+
+/* The latest version of the variables a load from "group" depends on */
+static unsigned int dep_version(struct mem_group *group)
+{
+	unsigned int version = 0;
+	int i;
+
+	for (i = 0; i < group->nr_deps; i++) {
+		if (group->deps[i]->version > version)
+			version = group->deps[i]->version;
+	}
+	return version;
+}
+
+/*
+ * Like dominates(), with what we know about the groups: 1 if "dom"
+ * accesses the same place as "insn", 0 if it can't change what
+ * "insn" reads and -1 if we don't know.
+ */
+static int memop_dominates(struct mem_group *group, struct instruction *insn, struct instruction *dom)
+{
+	struct mem_group *other;
+
+	switch (dom->opcode) {
+	case OP_CALL: case OP_ENTRY:
+		return group->local ? 0 : -1;
+	case OP_LOAD: case OP_STORE: case OP_INIT:
+		break;
+	default:
+		return 0;
+	}
+	other = dom->src->priv;
+	if (other != group) {
+		if (dom->opcode == OP_LOAD)
+			return 0;
+		return (!other || may_alias(other, group)) ? -1 : 0;
+	}
+	if (dom->opcode != OP_INIT && dom->offset == insn->offset && dom->size == insn->size)
+		return 1;
+	if (dom->opcode == OP_LOAD || !overlapping(dom->offset, dom->size, insn->offset, insn->size))
+		return 0;
+	return -1;
+}
+
+static int find_dominating_parents(struct mem_group *group, struct instruction *insn,
 	struct basic_block *bb, unsigned long generation, struct pseudo_list **dominators,
-	int local, int loads)
+	int loads)
 {
 	struct basic_block *parent;
 
@@ -33,7 +566,9 @@ static int find_dominating_parents(pseudo_t pseudo, struct instruction *insn,
 			int dominance;
 			if (one == insn)
 				goto no_dominance;
-			dominance = dominates(pseudo, insn, one, local);
+			if (!--search_left)
+				return 0;
+			dominance = memop_dominates(group, insn, one);
 			if (dominance < 0) {
 				if (one->opcode == OP_LOAD)
 					continue;
@@ -50,7 +585,7 @@ no_dominance:
 			continue;
 		parent->generation = generation;
 
-		if (!find_dominating_parents(pseudo, insn, parent, generation, dominators, local, loads))
+		if (!find_dominating_parents(group, insn, parent, generation, dominators, loads))
 			return 0;
 		continue;
 
@@ -62,135 +597,414 @@ found_dominator:
 		use_pseudo(insn, phi, add_pseudo(dominators, phi));
 	} END_FOR_EACH_PTR(parent);
 	return 1;
-}		
+}
 
-static int address_taken(pseudo_t pseudo)
+/*
+ * The load comes after a phi-node of the memory: look for what was
+ * stored along each path into it, the long way. It's only worth it
+ * when the paths are short, so give up after SEARCH_LIMIT
+ * instructions for each load.
+ */
+static void search_dominating(struct mem_group *group, struct instruction *insn)
 {
-	struct pseudo_user *pu;
-	FOR_EACH_PTR(pseudo->users, pu) {
-		struct instruction *insn = pu->insn;
-		if (insn->bb && (insn->opcode != OP_LOAD && insn->opcode != OP_STORE))
+	struct basic_block *bb = insn->bb;
+	struct pseudo_list *dominators;
+	struct instruction *dom;
+	unsigned long generation;
+	int seen = 0;
+
+	search_left = SEARCH_LIMIT;
+	FOR_EACH_PTR_REVERSE(bb->insns, dom) {
+		int dominance;
+		if (!seen) {
+			seen = dom == insn;
+			continue;
+		}
+		if (!dom->bb)
+			continue;
+		dominance = memop_dominates(group, insn, dom);
+		if (dominance) {
+			/* possible partial dominance? */
+			if (dominance < 0)  {
+				if (dom->opcode == OP_LOAD)
+					continue;
+				return;
+			}
+			/* Yeehaa! Found one! */
+			convert_load_instruction(insn, dom->target);
+			return;
+		}
+	} END_FOR_EACH_PTR_REVERSE(dom);
+
+	/* OK, go find the parents */
+	generation = ++bb_generation;
+	bb->generation = generation;
+	dominators = NULL;
+	if (find_dominating_parents(group, insn, bb, generation, &dominators, 1)) {
+		/* This happens with initial assignments to structures etc.. */
+		if (!dominators) {
+			if (group->local)
+				convert_load_instruction(insn, value_pseudo(0));
+			return;
+		}
+		rewrite_load_instruction(insn, dominators);
+	}
+}
+
+static void simplify_load(struct mem_group *group, struct instruction *insn)
+{
+	unsigned int version = dep_version(group);
+	struct mem_entry *entry;
+
+	/* Check for illegal offsets.. */
+	check_access(insn);
+
+	for (entry = group->entries; entry; entry = entry->next) {
+		if (entry->dead || entry->offset != insn->offset || entry->size != insn->size)
+			continue;
+		if ((version >> 1) > entry->seq)
+			break;
+		/* Yeehaa! Found one! */
+		forward_load(insn, entry->value);
+		return;
+	}
+
+	if (!version) {
+		/* Never stored to on the way here */
+		if (group->local) {
+			forward_load(insn, value_pseudo(0));
+			return;
+		}
+	} else if (version & 1) {
+		add_instruction(&searches, insn);
+	}
+	add_entry(group, insn, insn->target);
+}
+
+static void simplify_store(struct mem_group *group, struct instruction *insn)
+{
+	unsigned int version = dep_version(group);
+	struct mem_entry *entry;
+	int i;
+
+	mem_seq++;
+	for (entry = group->entries; entry; entry = entry->next) {
+		if (entry->dead)
+			continue;
+		if (overlapping(entry->offset, entry->size, insn->offset, insn->size))
+			set_slot(&entry->dead, 1);
+		else if ((version >> 1) <= entry->seq)
+			/* Our own store doesn't change it */
+			set_slot(&entry->seq, mem_seq);
+	}
+	for (i = 0; i < group->nr_clobbers; i++)
+		set_slot(&group->clobbers[i]->version, mem_seq << 1);
+	/* An OP_INIT writes the whole thing, but no value we could forward */
+	if (insn->opcode == OP_STORE)
+		add_entry(group, insn, insn->target);
+}
+
+static void simplify_loads(struct basic_block *bb, struct mem_var_list *phis)
+{
+	struct instruction *insn;
+	struct mem_var *var;
+
+	if (phis) {
+		mem_seq++;
+		FOR_EACH_PTR(phis, var) {
+			set_slot(&var->version, (mem_seq << 1) | 1);
+		} END_FOR_EACH_PTR(var);
+	}
+
+	FOR_EACH_PTR(bb->insns, insn) {
+		if (!insn->bb)
+			continue;
+		switch (insn->opcode) {
+		case OP_LOAD:
+			simplify_load(insn->src->priv, insn);
+			break;
+		case OP_STORE: case OP_INIT:
+			simplify_store(insn->src->priv, insn);
+			break;
+		case OP_CALL:
+			set_slot(&call_var->version, ++mem_seq << 1);
+			break;
+		}
+	} END_FOR_EACH_PTR(insn);
+}
+
+static int read_since(struct mem_group *group, unsigned int seq)
+{
+	int i;
+
+	if (!group->local && call_var->read > seq)
+		return 1;
+	for (i = 1; i < group->nr_clobbers; i++) {
+		struct mem_var *var = group->clobbers[i];
+		unsigned int read = var->reader != group ? var->read : var->other_read;
+		if (read > seq)
 			return 1;
-	} END_FOR_EACH_PTR(pu);
+	}
 	return 0;
 }
 
-static int local_pseudo(pseudo_t pseudo)
+static void mark_read(struct mem_group *group, struct instruction *insn)
 {
-	return pseudo->type == PSEUDO_SYM
-		&& !(pseudo->sym->ctype.modifiers & (MOD_STATIC | MOD_NONLOCAL))
-		&& !address_taken(pseudo);
+	struct mem_entry *entry;
+	int i;
+
+	mem_seq++;
+	for (i = 1; i < group->nr_deps; i++) {
+		struct mem_var *var = group->deps[i];
+		if (var->reader != group) {
+			var->other_read = var->read;
+			var->reader = group;
+		}
+		var->read = mem_seq;
+	}
+	if (group->pending_bb != insn->bb)
+		return;
+	for (entry = group->pending; entry; entry = entry->next) {
+		if (overlapping(entry->offset, entry->size, insn->offset, insn->size))
+			entry->dead = 1;
+	}
 }
 
-static void simplify_loads(struct basic_block *bb)
+/*
+ * Kill the stores that are overwritten further down the same bb
+ * before anything could have read them.
+ */
+static void kill_dominated_stores(struct entrypoint *ep, struct basic_block *bb,
+	struct mem_entry *pending)
 {
 	struct instruction *insn;
 
-	FOR_EACH_PTR_REVERSE(bb->insns, insn) {
+	FOR_EACH_PTR(bb->insns, insn) {
+		struct mem_group *group;
+		struct mem_entry *entry;
+
 		if (!insn->bb)
 			continue;
-		if (insn->opcode == OP_LOAD) {
-			struct instruction *dom;
-			pseudo_t pseudo = insn->src;
-			int local = local_pseudo(pseudo);
-			struct pseudo_list *dominators;
-			unsigned long generation;
+		switch (insn->opcode) {
+		case OP_LOAD:
+			mark_read(memop_group(ep, insn->src), insn);
+			continue;
+		case OP_CALL:
+			call_var->read = ++mem_seq;
+			continue;
+		case OP_STORE:
+			break;
+		default:
+			continue;
+		}
+
+		group = memop_group(ep, insn->src);
+		if (group->pending_bb != bb) {
+			group->pending_bb = bb;
+			group->pending = NULL;
+		}
+		for (entry = group->pending; entry; entry = entry->next) {
+			if (entry->dead || entry->offset != insn->offset || entry->size != insn->size)
+				continue;
+			if (!read_since(group, entry->seq)) {
+				/* Yeehaa! Found one! */
+				kill_store(entry->insn);
+			}
+			entry->dead = 1;
+		}
+		entry = pending++;
+		entry->insn = insn;
+		entry->offset = insn->offset;
+		entry->size = insn->size;
+		entry->seq = ++mem_seq;
+		entry->dead = 0;
+		entry->next = group->pending;
+		group->pending = entry;
+	} END_FOR_EACH_PTR(insn);
+}
 
-			/* Check for illegal offsets.. */
-			check_access(insn);
+static void add_def(struct mem_var *var, struct basic_block *bb)
+{
+	if (var->last_def != bb) {
+		var->last_def = bb;
+		add_bb(&var->defs, bb);
+	}
+}
 
-			RECURSE_PTR_REVERSE(insn, dom) {
-				int dominance;
-				if (!dom->bb)
+/* Where the variables need phi-nodes: the IDF of their stores */
+static void place_phis(struct mem_var_list **phis, int nr)
+{
+	struct basic_block **work = alloc_mem(nr, sizeof(*work));
+	int *queued = alloc_mem(nr, sizeof(*queued));
+	int *placed = alloc_mem(nr, sizeof(*placed));
+	struct mem_var *var;
+
+	for (var = mem_vars; var; var = var->next) {
+		struct basic_block *bb, *df;
+		int id = ++nr_vars, top = 0;
+
+		FOR_EACH_PTR(var->defs, bb) {
+			queued[bb->postorder_nr] = id;
+			work[top++] = bb;
+		} END_FOR_EACH_PTR(bb);
+		while (top) {
+			bb = work[--top];
+			FOR_EACH_PTR(bb->df, df) {
+				int n = df->postorder_nr;
+				if (placed[n] == id)
 					continue;
-				dominance = dominates(pseudo, insn, dom, local);
-				if (dominance) {
-					/* possible partial dominance? */
-					if (dominance < 0)  {
-						if (dom->opcode == OP_LOAD)
-							continue;
-						goto next_load;
-					}
-					/* Yeehaa! Found one! */
-					convert_load_instruction(insn, dom->target);
-					goto next_load;
-				}
-			} END_FOR_EACH_PTR_REVERSE(dom);
-
-			/* OK, go find the parents */
-			generation = ++bb_generation;
-			bb->generation = generation;
-			dominators = NULL;
-			if (find_dominating_parents(pseudo, insn, bb, generation, &dominators, local, 1)) {
-				/* This happens with initial assignments to structures etc.. */
-				if (!dominators) {
-					if (local) {
-						assert(pseudo->type != PSEUDO_ARG);
-						convert_load_instruction(insn, value_pseudo(0));
-					}
-					goto next_load;
-				}
-				rewrite_load_instruction(insn, dominators);
-			}
+				placed[n] = id;
+				add_ptr_list(&phis[n], var);
+				if (queued[n] == id)
+					continue;
+				queued[n] = id;
+				work[top++] = df;
+			} END_FOR_EACH_PTR(df);
 		}
-next_load:
-		/* Do the next one */;
-	} END_FOR_EACH_PTR_REVERSE(insn);
+	}
+	free(placed);
+	free(queued);
+	free(work);
 }
 
-static void kill_store(struct instruction *insn)
+static void free_memops(void)
 {
-	if (insn) {
-		insn->bb = NULL;
-		insn->opcode = OP_SNOP;
-		kill_use(&insn->target);
+	while (mem_vars) {
+		struct mem_var *var = mem_vars;
+		mem_vars = var->next;
+		free_ptr_list(&var->defs);
+		if (var->kind != MEM_OWN)
+			free(var);
+	}
+	while (mem_groups) {
+		struct mem_group *group = mem_groups;
+		mem_groups = group->next;
+		group->addr->priv = NULL;
+		free(group->deps);
+		free(group->clobbers);
+		free(group);
 	}
 }
 
-static void kill_dominated_stores(struct basic_block *bb)
+/* Going down the dominator tree, putting things back on the way up */
+static void forward_loads(struct entrypoint *ep)
 {
+	int nr = ep->entry->bb->postorder_nr + 1;
+	struct mem_var_list **phis;
 	struct instruction *insn;
+	struct basic_block *bb;
+	struct {
+		struct basic_block *bb;
+		int mark;
+	} *stack;
+	int top;
 
-	FOR_EACH_PTR_REVERSE(bb->insns, insn) {
-		if (!insn->bb)
-			continue;
-		if (insn->opcode == OP_STORE) {
-			struct instruction *dom;
-			pseudo_t pseudo = insn->src;
-			int local = local_pseudo(pseudo);
+	build_dom_frontiers(ep);
+	phis = alloc_mem(nr, sizeof(*phis));
+	place_phis(phis, nr);
 
-			RECURSE_PTR_REVERSE(insn, dom) {
-				int dominance;
-				if (!dom->bb)
-					continue;
-				dominance = dominates(pseudo, insn, dom, local);
-				if (dominance) {
-					/* possible partial dominance? */
-					if (dominance < 0)
-						goto next_store;
-					if (dom->opcode == OP_LOAD)
-						goto next_store;
-					/* Yeehaa! Found one! */
-					kill_store(dom);
-				}
-			} END_FOR_EACH_PTR_REVERSE(dom);
+	stack = alloc_mem(2 * nr, sizeof(*stack));
+	top = 0;
+	stack[top].bb = ep->entry->bb;
+	stack[top++].mark = -1;
+	while (top) {
+		struct basic_block *child;
 
-			/* OK, we should check the parents now */
+		bb = stack[--top].bb;
+		if (stack[top].mark >= 0) {
+			undo_to(stack[top].mark);
+			continue;
 		}
-next_store:
-		/* Do the next one */;
-	} END_FOR_EACH_PTR_REVERSE(insn);
+		stack[top++].mark = undo_nr;
+		simplify_loads(bb, phis[bb->postorder_nr]);
+		FOR_EACH_PTR_REVERSE(bb->doms, child) {
+			stack[top].bb = child;
+			stack[top++].mark = -1;
+		} END_FOR_EACH_PTR_REVERSE(child);
+	}
+	free(stack);
+	for (top = 0; top < nr; top++)
+		free_ptr_list(&phis[top]);
+	free(phis);
+
+	/*
+	 * Only now change the loads, their targets may be addresses.
+	 * A load can be forwarded the target of an earlier one which is
+	 * itself forwarded: go backwards, so that the users of the later
+	 * load are moved onto that target before it gets replaced too.
+	 */
+	for (top = forward_nr; top-- > 0; )
+		convert_load_instruction(forwards[top].insn, forwards[top].value);
+	forward_nr = 0;
+	FOR_EACH_PTR(searches, insn) {
+		if (insn->bb && insn->opcode == OP_LOAD)
+			search_dominating(memop_group(ep, insn->src), insn);
+	} END_FOR_EACH_PTR(insn);
+	free_ptr_list(&searches);
 }
 
 void simplify_memops(struct entrypoint *ep)
 {
+	int nr_loads = 0, nr_stores = 0, max_insns = 0;
+	struct mem_group *group;
 	struct basic_block *bb;
 
-	FOR_EACH_PTR_REVERSE(ep->bbs, bb) {
-		simplify_loads(bb);
-	} END_FOR_EACH_PTR_REVERSE(bb);
+	if (!ep->dom_valid)
+		build_dom_tree(ep);
+	mem_seq = 0;
+	nr_vars = 0;
+	call_var = new_var(MEM_CALL);
+
+	/* Sort the accesses into groups, and find their stores */
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *insn;
+		int i, nr_insns = 0;
+
+		if (!bb->dom_pre)
+			continue;
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (!insn->bb)
+				continue;
+			nr_insns++;
+			switch (insn->opcode) {
+			case OP_LOAD:
+				memop_group(ep, insn->src);
+				nr_loads++;
+				break;
+			case OP_STORE: case OP_INIT:
+				group = memop_group(ep, insn->src);
+				for (i = 0; i < group->nr_clobbers; i++)
+					add_def(group->clobbers[i], bb);
+				nr_stores += insn->opcode == OP_STORE;
+				break;
+			case OP_CALL:
+				add_def(call_var, bb);
+				break;
+			}
+		} END_FOR_EACH_PTR(insn);
+		if (nr_insns > max_insns)
+			max_insns = nr_insns;
+	} END_FOR_EACH_PTR(bb);
+
+	/* The groups' own variables only need phi-nodes if stored to */
+	for (group = mem_groups; group; group = group->next) {
+		if (group->own.defs) {
+			group->own.next = mem_vars;
+			mem_vars = &group->own;
+		}
+	}
+
+	if (nr_loads)
+		forward_loads(ep);
 
-	FOR_EACH_PTR_REVERSE(ep->bbs, bb) {
-		kill_dominated_stores(bb);
-	} END_FOR_EACH_PTR_REVERSE(bb);
+	if (nr_stores > 1) {
+		struct mem_entry *pending = alloc_mem(max_insns, sizeof(*pending));
+
+		FOR_EACH_PTR(ep->bbs, bb) {
+			if (bb->dom_pre)
+				kill_dominated_stores(ep, bb, pending);
+		} END_FOR_EACH_PTR(bb);
+		free(pending);
+	}
+	free_memops();
 }
@@ -0,0 +1,222 @@
+/*
+ * Pass - run the optimisation passes on an entrypoint, and keep
+ * track of what each of them costs and does.
+ *
+ * linearize_fn() still decides the order and when to go round
+ * again; it just goes through run_pass() to do it. That is where
+ * "-fpasses=" turns the optional passes off, and where the
+ * "-fdump-pass-stats" numbers come from: how often each pass ran,
+ * how often it changed something, the time it took and how many
+ * instructions and bbs it added or removed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "parse.h"
+#include "expression.h"
+#include "linearize.h"
+#include "flow.h"
+
+int dump_pass_stats = 0;
+
+struct pass_stats {
+	unsigned long long runs, changed, nsecs;
+	long long insns, bbs;
+};
+
+struct pass {
+	const char *name;
+	int (*run)(struct entrypoint *ep);
+	int optional;
+};
+
+static int run_unreachable(struct entrypoint *ep)
+{
+	kill_unreachable_bbs(ep);
+	return 0;
+}
+
+static int run_symbols(struct entrypoint *ep)
+{
+	simplify_symbol_usage(ep);
+	return 0;
+}
+
+static int run_cse(struct entrypoint *ep)
+{
+	cleanup_and_cse(ep);
+	return repeat_phase & REPEAT_CSE;
+}
+
+static int run_pack(struct entrypoint *ep)
+{
+	pack_basic_blocks(ep);
+	return repeat_phase & REPEAT_CSE;
+}
+
+static int run_liveness(struct entrypoint *ep)
+{
+	track_pseudo_liveness(ep);
+	return 0;
+}
+
+static int run_death(struct entrypoint *ep)
+{
+	track_pseudo_death(ep);
+	return 0;
+}
+
+static const struct pass passes[NR_PASSES] = {
+	[PASS_UNREACHABLE]	= { "unreachable", run_unreachable, 0 },
+	[PASS_SYMBOLS]		= { "symbols", run_symbols, 1 },
+	[PASS_SCCP]		= { "sccp", simplify_constants, 1 },
+	[PASS_CSE]		= { "cse", run_cse, 1 },
+	[PASS_PACK]		= { "pack", run_pack, 1 },
+	[PASS_LIVENESS]		= { "liveness", run_liveness, 0 },
+	[PASS_FLOW]		= { "flow", simplify_flow, 1 },
+	[PASS_DEATH]		= { "death", run_death, 0 },
+};
+
+static unsigned int disabled_passes;
+static struct pass_stats fn_stats[NR_PASSES], all_stats[NR_PASSES];
+
+/*
+ * "list" is a comma separated list of the optional passes to run,
+ * "all" or "none"; the others always run. Each entry overrides the
+ * ones before it: "none,cse" is only cse. Returns the entry that
+ * isn't one of these, NULL if there is none.
+ */
+const char *select_passes(const char *list)
+{
+	unsigned int optional = 0, disabled;
+	int i;
+
+	for (i = 0; i < NR_PASSES; i++) {
+		if (passes[i].optional)
+			optional |= 1U << i;
+	}
+	disabled = optional;
+	while (*list) {
+		size_t len = strcspn(list, ",");
+
+		if (len == 3 && !strncmp(list, "all", 3))
+			disabled = 0;
+		else if (len == 4 && !strncmp(list, "none", 4))
+			disabled = optional;
+		else {
+			for (i = 0; i < NR_PASSES; i++) {
+				if (strlen(passes[i].name) == len && !strncmp(list, passes[i].name, len))
+					break;
+			}
+			if (i == NR_PASSES || !passes[i].optional)
+				return list;
+			disabled &= ~(1U << i);
+		}
+		list += len;
+		if (*list)
+			list++;
+	}
+	disabled_passes = disabled;
+	return NULL;
+}
+
+static void count_ir(struct entrypoint *ep, long long *insns, long long *bbs)
+{
+	struct basic_block *bb;
+
+	*insns = *bbs = 0;
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *insn;
+
+		if (!bb->ep || !bb->insns)
+			continue;
+		(*bbs)++;
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (insn->bb)
+				(*insns)++;
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(bb);
+}
+
+static unsigned long long now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Run a pass on "ep", if it's enabled. Returns whether it asks for
+ * the passes before it to be run again.
+ */
+int run_pass(struct entrypoint *ep, enum pass_id id)
+{
+	struct pass_stats *stats = &fn_stats[id];
+	long long insns, bbs, new_insns, new_bbs;
+	unsigned long long start;
+	int changed;
+
+	if (disabled_passes & (1U << id))
+		return 0;
+	if (!dump_pass_stats)
+		return passes[id].run(ep);
+
+	count_ir(ep, &insns, &bbs);
+	start = now();
+	changed = passes[id].run(ep);
+	stats->nsecs += now() - start;
+	count_ir(ep, &new_insns, &new_bbs);
+
+	stats->runs++;
+	if (changed || new_insns != insns || new_bbs != bbs)
+		stats->changed++;
+	stats->insns += new_insns - insns;
+	stats->bbs += new_bbs - bbs;
+	return changed;
+}
+
+static void show_stats(const char *title, struct pass_stats *stats)
+{
+	int i;
+
+	fprintf(stderr, "pass stats for %s:\n", title);
+	fprintf(stderr, "  %-12s %8s %8s %10s %8s %8s\n",
+		"pass", "runs", "changed", "usecs", "insns", "bbs");
+	for (i = 0; i < NR_PASSES; i++, stats++) {
+		if (!stats->runs)
+			continue;
+		fprintf(stderr, "  %-12s %8llu %8llu %10llu %+8lld %+8lld\n",
+			passes[i].name, stats->runs, stats->changed,
+			stats->nsecs / 1000, stats->insns, stats->bbs);
+	}
+}
+
+/*
+ * Report on the passes run on "ep", and add them to the totals
+ * for show_all_pass_stats().
+ */
+void show_pass_stats(struct entrypoint *ep)
+{
+	int i;
+
+	if (!dump_pass_stats)
+		return;
+	show_stats(show_ident(ep->name->ident), fn_stats);
+	for (i = 0; i < NR_PASSES; i++) {
+		all_stats[i].runs += fn_stats[i].runs;
+		all_stats[i].changed += fn_stats[i].changed;
+		all_stats[i].nsecs += fn_stats[i].nsecs;
+		all_stats[i].insns += fn_stats[i].insns;
+		all_stats[i].bbs += fn_stats[i].bbs;
+	}
+	memset(fn_stats, 0, sizeof(fn_stats));
+}
+
+void show_all_pass_stats(void)
+{
+	if (dump_pass_stats)
+		show_stats("all functions", all_stats);
+}
@@ -114,10 +114,9 @@ static void replace_with_string(struct token *token, const char *str)
 
 static void replace_with_integer(struct token *token, unsigned int val)
 {
-	char *buf = __alloc_bytes(11);
-	sprintf(buf, "%u", val);
-	token_type(token) = TOKEN_NUMBER;
-	token->number = buf;
+	char buf[11];
+	int len = sprintf(buf, "%u", val);
+	set_token_number(token, buf, len + 1);
 }
 
 static struct symbol *lookup_macro(struct ident *ident)
@@ -148,8 +147,7 @@ static void replace_with_defined(struct token *token)
 	static const char *string[] = { "0", "1" };
 	int defined = token_defined(token);
 
-	token_type(token) = TOKEN_NUMBER;
-	token->number = string[defined];
+	set_token_number(token, string[defined], 2);
 }
 
 static int expand_one_symbol(struct token **list)
@@ -439,6 +437,10 @@ static enum token_type combine(struct token *left, struct token *right, char *p)
 	int len;
 	enum token_type t1 = token_type(left), t2 = token_type(right);
 
+	if (t1 == TOKEN_NUMBER_EMBEDDED)
+		t1 = TOKEN_NUMBER;
+	if (t2 == TOKEN_NUMBER_EMBEDDED)
+		t2 = TOKEN_NUMBER;
 	if (t1 != TOKEN_IDENT && t1 != TOKEN_NUMBER && t1 != TOKEN_SPECIAL)
 		return TOKEN_ERROR;
 
@@ -500,13 +502,9 @@ static int merge(struct token *left, struct token *right)
 		left->pos.noexpand = 0;
 		return 1;
 
-	case TOKEN_NUMBER: {
-		char *number = __alloc_bytes(strlen(buffer) + 1);
-		memcpy(number, buffer, strlen(buffer) + 1);
-		token_type(left) = TOKEN_NUMBER;	/* could be . + num */
-		left->number = number;
+	case TOKEN_NUMBER:	/* could be . + num */
+		set_token_number(left, buffer, strlen(buffer) + 1);
 		return 1;
-	}
 
 	case TOKEN_SPECIAL:
 		if (buffer[2] && buffer[3])
@@ -753,28 +751,25 @@ static const char *token_name_sequence(struct token *token, int endop, struct to
 	return buffer;
 }
 
-static int already_tokenized(const char *path)
+/*
+ * Including the file of stream "s" again would add nothing: it had
+ * #pragma once, or all of it sits under an include guard that is
+ * still defined.
+ */
+static int still_protected(struct stream *s)
 {
-	int stream, next;
-
-	for (stream = *hash_stream(path); stream >= 0 ; stream = next) {
-		struct stream *s = input_streams + stream;
-
-		next = s->next_stream;
-		if (s->once) {
-			if (strcmp(path, s->name))
-				continue;
-			return 1;
-		}
-		if (s->constant != CONSTANT_FILE_YES)
-			continue;
-		if (strcmp(path, s->name))
-			continue;
-		if (s->protect && !lookup_macro(s->protect))
-			continue;
+	if (s->once)
 		return 1;
-	}
-	return 0;
+	if (s->constant != CONSTANT_FILE_YES)
+		return 0;
+	if (s->protect && !lookup_macro(s->protect))
+		return 0;
+	return 1;
+}
+
+static int already_tokenized(const char *path)
+{
+	return find_stream(path, still_protected) >= 0;
 }
 
 /* Handle include of header files.
@@ -853,7 +848,12 @@ static int try_include(const char *path, const char *filename, int flen, struct
 		return 1;
 	fd = open(fullname, O_RDONLY);
 	if (fd >= 0) {
-		char * streamname = __alloc_bytes(plen + flen);
+		char * streamname;
+		if (find_stream_file(fd, still_protected) >= 0) {
+			close(fd);
+			return 1;
+		}
+		streamname = __alloc_bytes(plen + flen);
 		memcpy(streamname, fullname, plen + flen);
 		*where = tokenize(streamname, fd, *where, next_path);
 		close(fd);
@@ -884,6 +884,34 @@ static int free_preprocessor_line(struct token *token)
 	return 1;
 }
 
+/*
+ * A token that came straight from the tokenizer and never went
+ * through macro expansion is the only user of its string or
+ * number, so those can be recycled along with the token.
+ */
+static void free_raw_token_data(struct token *token)
+{
+	switch (token_type(token)) {
+	case TOKEN_NUMBER:
+		__free_sized_bytes((void *)token->number, strlen(token->number) + 1);
+		break;
+	case TOKEN_CHAR:
+	case TOKEN_WIDE_CHAR:
+	case TOKEN_STRING:
+	case TOKEN_WIDE_STRING:
+		__free_sized_string(token->string, token->string->length);
+		break;
+	default:
+		break;
+	}
+}
+
+static void free_raw_line_data(struct token *token)
+{
+	for (; token_type(token) != TOKEN_EOF; token = token->next)
+		free_raw_token_data(token);
+}
+
 static int handle_include_path(struct stream *stream, struct token **list, struct token *token, int how)
 {
 	const char *filename;
@@ -969,7 +997,8 @@ static int token_different(struct token *t1, struct token *t2)
 		different = 0;
 		break;
 	case TOKEN_NUMBER:
-		different = strcmp(t1->number, t2->number);
+	case TOKEN_NUMBER_EMBEDDED:
+		different = strcmp(token_number(t1), token_number(t2));
 		break;
 	case TOKEN_SPECIAL:
 		different = t1->special != t2->special;
@@ -1349,6 +1378,9 @@ static int do_handle_define(struct stream *stream, struct token **line, struct t
 	sym->used_in = NULL;
 	sym->attr = attr;
 out:
+	/* The line is dropped without ever having been expanded */
+	if (ret)
+		free_raw_line_data(token);
 	return ret;
 }
 
@@ -1901,7 +1933,7 @@ static void handle_preprocessor_line(struct stream *stream, struct token **line,
 		} else {
 			handler = handle_nondirective;
 		}
-	} else if (token_type(token) == TOKEN_NUMBER) {
+	} else if (token_is_number(token_type(token))) {
 		handler = handle_line;
 	} else {
 		handler = handle_nondirective;
@@ -1909,8 +1941,10 @@ static void handle_preprocessor_line(struct stream *stream, struct token **line,
 
 	if (is_normal) {
 		dirty_stream(stream);
-		if (false_nesting)
+		if (false_nesting) {
+			free_raw_line_data(token);
 			goto out;
+		}
 	}
 	if (!handler(stream, line, token))	/* all set */
 		return;
@@ -1970,6 +2004,7 @@ static void do_preprocess(struct token **list)
 			dirty_stream(stream);
 			if (false_nesting) {
 				*list = next->next;
+				free_raw_token_data(next);
 				__free_token(next);
 				continue;
 			}
@@ -1983,6 +2018,8 @@ static void do_preprocess(struct token **list)
 
 struct token * preprocess(struct token *token)
 {
+	enum alloc_phase phase = set_alloc_phase(ALLOC_PHASE_PREPROCESS);
+
 	preprocessing = 1;
 	init_preprocessor();
 	do_preprocess(&token);
@@ -1991,6 +2028,7 @@ struct token * preprocess(struct token *token)
 	// This is not true when we have multiple files, though ;/
 	// clear_expression_alloc();
 	preprocessing = 0;
+	set_alloc_phase(phase);
 
 	return token;
 }
@@ -6,6 +6,7 @@
  * (C) Copyright Linus Torvalds 2003-2005
  */
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <assert.h>
 
@@ -13,9 +14,55 @@
 #include "allocate.h"
 #include "compat.h"
 
-__DECLARE_ALLOCATOR(struct ptr_list, ptrlist);
 __ALLOCATOR(struct ptr_list, "ptr list", ptrlist);
 
+#define PTR_VEC_MIN_BYTES (128)
+
+static inline int vec_node_bytes(int size)
+{
+	return offsetof(struct ptr_list, list) + size * sizeof(void *);
+}
+
+/*
+ * Vector nodes are sized in powers of two bytes, so that the
+ * ones freed when a vector grows can be reused by the size
+ * classes of the allocator.
+ */
+static struct ptr_list *alloc_vec_node(int bytes)
+{
+	struct ptr_list *node;
+
+	node = __alloc_ptrlist(bytes - (int) sizeof(struct ptr_list));
+	node->size = (bytes - offsetof(struct ptr_list, list)) / sizeof(void *);
+	return node;
+}
+
+static inline int node_full(struct ptr_list *list)
+{
+	return list->nr >= ptr_list_node_nr(list);
+}
+
+static struct ptr_list *alloc_node_like(struct ptr_list *list)
+{
+	if (list->size)
+		return alloc_vec_node(vec_node_bytes(list->size));
+	return __alloc_ptrlist(0);
+}
+
+/*
+ * Nodes come in several sizes, so they all go back on the size
+ * classes: the plain freelist would hand a small node out again
+ * for a big one.
+ */
+static void free_node(struct ptr_list *list)
+{
+	int extra = 0;
+
+	if (list->size)
+		extra = vec_node_bytes(list->size) - (int) sizeof(struct ptr_list);
+	__free_sized_ptrlist(list, extra);
+}
+
 int ptr_list_size(struct ptr_list *head)
 {
 	int nr = 0;
@@ -77,14 +124,14 @@ restart:
 			if (!entry->nr) {
 				struct ptr_list *prev;
 				if (next == entry) {
-					__free_ptrlist(entry);
+					free_node(entry);
 					*listp = NULL;
 					return;
 				}
 				prev = entry->prev;
 				prev->next = next;
 				next->prev = prev;
-				__free_ptrlist(entry);
+				free_node(entry);
 				if (entry == head) {
 					*listp = next;
 					head = next;
@@ -100,7 +147,7 @@ restart:
 void split_ptr_list_head(struct ptr_list *head)
 {
 	int old = head->nr, nr = old / 2;
-	struct ptr_list *newlist = __alloc_ptrlist(0);
+	struct ptr_list *newlist = alloc_node_like(head);
 	struct ptr_list *next = head->next;
 
 	old -= nr;
@@ -124,10 +171,13 @@ void **__add_ptr_list(struct ptr_list **listp, void *ptr, unsigned long tag)
 	/* The low two bits are reserved for tags */
 	assert((3 & (unsigned long)ptr) == 0);
 	assert((~3 & tag) == 0);
-	ptr = (void *)(tag | (unsigned long)ptr);
 
-	if (!list || (nr = (last = list->prev)->nr) >= LIST_NODE_NR) {
-		struct ptr_list *newlist = __alloc_ptrlist(0);
+	if (!list || node_full(last = list->prev)) {
+		struct ptr_list *newlist;
+
+		if (list && last->size)
+			return __add_ptr_vec(listp, ptr, tag);
+		newlist = __alloc_ptrlist(0);
 		if (!list) {
 			newlist->next = newlist;
 			newlist->prev = newlist;
@@ -139,15 +189,52 @@ void **__add_ptr_list(struct ptr_list **listp, void *ptr, unsigned long tag)
 			last->next = newlist;
 		}
 		last = newlist;
-		nr = 0;
 	}
+	nr = last->nr;
 	ret = last->list + nr;
-	*ret = ptr;
+	*ret = (void *)(tag | (unsigned long)ptr);
 	nr++;
 	last->nr = nr;
 	return ret;
 }
 
+/*
+ * Add to a list, making it a vector if it's empty. When the last
+ * node is full, the next one is twice its size (up to the most
+ * the allocator can hand out), so a vector of n entries has only
+ * log(n) nodes; after a full node of a plain list, the vector
+ * starts again from the smallest size. Nodes are never moved, so
+ * pointers into the list and walks that add to it stay valid, as
+ * with any other list.
+ */
+void **__add_ptr_vec(struct ptr_list **listp, void *ptr, unsigned long tag)
+{
+	struct ptr_list *list = *listp;
+	struct ptr_list *last, *newlist;
+
+	if (!list) {
+		newlist = alloc_vec_node(PTR_VEC_MIN_BYTES);
+		newlist->next = newlist;
+		newlist->prev = newlist;
+		*listp = newlist;
+	} else if (node_full(last = list->prev)) {
+		int bytes = PTR_VEC_MIN_BYTES;
+
+		if (last->size) {
+			bytes = 2 * vec_node_bytes(last->size);
+			if (bytes > PTR_VEC_MAX_BYTES)
+				bytes = PTR_VEC_MAX_BYTES;
+		}
+		newlist = alloc_vec_node(bytes);
+		newlist->prev = last;
+		newlist->next = list;
+		list->prev = newlist;
+		last->next = newlist;
+	}
+	/* There's room now, and the rest is the same as for a list */
+	return __add_ptr_list(listp, ptr, tag);
+}
+
 int delete_ptr_list_entry(struct ptr_list **list, void *entry, int count)
 {
 	void *ptr;
@@ -217,7 +304,7 @@ void * delete_ptr_list_last(struct ptr_list **head)
 		last->prev->next = first;
 		if (last == first)
 			*head = NULL;
-		__free_ptrlist(last);
+		free_node(last);
 	}
 	return ptr;
 }
@@ -241,7 +328,7 @@ void __free_ptr_list(struct ptr_list **listp)
 	while (list) {
 		tmp = list;
 		list = list->next;
-		__free_ptrlist(tmp);
+		free_node(tmp);
 	}
 
 	*listp = NULL;
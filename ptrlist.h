@@ -24,13 +24,25 @@
 
 #define LIST_NODE_NR (29)
 
+/*
+ * A list can also be a vector, whose nodes double in size as it
+ * grows (see add_ptr_vec()), so that walking it is mostly a plain
+ * array walk. It's used with the same macros as any other list.
+ * Vector nodes have their 'size' set, others have it zero and
+ * room for LIST_NODE_NR entries.
+ */
+#define PTR_VEC_MAX_BYTES (16384)
+
 struct ptr_list {
 	int nr;
+	int size;
 	struct ptr_list *prev;
 	struct ptr_list *next;
 	void *list[LIST_NODE_NR];
 };
 
+#define ptr_list_node_nr(l) ((l)->size ? (l)->size : LIST_NODE_NR)
+
 #define ptr_list_empty(x) ((x) == NULL)
 
 void * undo_ptr_list_last(struct ptr_list **head);
@@ -40,6 +52,7 @@ int replace_ptr_list_entry(struct ptr_list **, void *old, void *new, int);
 extern void sort_list(struct ptr_list **, int (*)(const void *, const void *));
 
 extern void **__add_ptr_list(struct ptr_list **, void *, unsigned long);
+extern void **__add_ptr_vec(struct ptr_list **, void *, unsigned long);
 extern void concat_ptr_list(struct ptr_list *a, struct ptr_list **b);
 extern void __free_ptr_list(struct ptr_list **);
 extern int ptr_list_size(struct ptr_list *);
@@ -59,6 +72,10 @@ extern int linearize_ptr_list(struct ptr_list *, void **, int);
 								    (unsigned long)(entry) & 3)))
 #define add_ptr_list(list,entry) \
 	add_ptr_list_tag(list,entry,0)
+#define add_ptr_vec_tag(list,entry,tag) \
+	MKTYPE(*(list), (CHECK_TYPE(*(list),(entry)),__add_ptr_vec((struct ptr_list **)(list), (entry), (tag))))
+#define add_ptr_vec(list,entry) \
+	add_ptr_vec_tag(list,entry,0)
 #define free_ptr_list(list) \
 	do { VRFY_PTR_LIST(*(list)); __free_ptr_list((struct ptr_list **)(list)); } while (0)
 
@@ -229,7 +246,7 @@ extern void split_ptr_list_head(struct ptr_list *);
 
 #define DO_INSERT_CURRENT(new, ptr, __head, __list, __nr) do {				\
 	void **__this, **__last;							\
-	if (__list->nr == LIST_NODE_NR)							\
+	if (__list->nr == ptr_list_node_nr(__list))					\
 		DO_SPLIT(ptr, __head, __list, __nr);					\
 	__this = __list->list + __nr;							\
 	__last = __list->list + __list->nr - 1;						\
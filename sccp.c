@@ -0,0 +1,437 @@
+/*
+ * SCCP - sparse conditional constant propagation (Wegman & Zadeck).
+ *
+ * Every pseudo starts off as "undefined" and every bb as not
+ * executable. Going from the entry, only the bbs a branch can
+ * actually take are marked executable, and only the instructions
+ * in those are evaluated; a pseudo goes down to a constant, then
+ * to "varying", as its operands do. So a phi-node whose sources
+ * only come from bbs that can't execute doesn't stop its value
+ * from being a constant, and a branch on that value then drops
+ * those bbs for good.
+ *
+ * Sparse's phi-nodes take the value of the last phi source that
+ * executed, not the one on the edge they came in by, so a phi-node
+ * meets the sources in all the executable bbs.
+ */
+
+#include <stdlib.h>
+
+#include "parse.h"
+#include "expression.h"
+#include "linearize.h"
+#include "flow.h"
+
+enum ccp_state {
+	CCP_UNDEF,
+	CCP_CONST,
+	CCP_VARYING,
+};
+
+struct ccp_value {
+	enum ccp_state state;
+	long long value;
+	pseudo_t pseudo;
+};
+
+static struct ccp_value varying = { CCP_VARYING };
+
+static struct instruction **insn_work;
+static int insn_nr, insn_size;
+static struct basic_block **bb_work;
+static int bb_nr;
+static unsigned long executable;
+
+static void *alloc_ccp(int nr, int size)
+{
+	void *ptr = calloc(nr, size);
+
+	if (!ptr)
+		die("out of memory");
+	return ptr;
+}
+
+static inline int is_executable(struct basic_block *bb)
+{
+	return bb && bb->generation == executable;
+}
+
+static void mark_executable(struct basic_block *bb)
+{
+	if (!bb || bb->generation == executable)
+		return;
+	bb->generation = executable;
+	bb_work[bb_nr++] = bb;
+}
+
+static void queue_insn(struct instruction *insn)
+{
+	if (!insn->bb || !is_executable(insn->bb))
+		return;
+	if (insn_nr == insn_size) {
+		insn_size = insn_size ? insn_size * 2 : 64;
+		insn_work = realloc(insn_work, insn_size * sizeof(*insn_work));
+		if (!insn_work)
+			die("out of memory");
+	}
+	insn_work[insn_nr++] = insn;
+}
+
+static inline int defines(struct instruction *insn)
+{
+	pseudo_t target = insn->target;
+
+	if (insn->opcode == OP_BR || insn->opcode == OP_SWITCH)
+		return 0;
+	return target && (target->type == PSEUDO_REG || target->type == PSEUDO_PHI) &&
+		target->def == insn;
+}
+
+static struct ccp_value *get_value(pseudo_t pseudo, struct ccp_value *tmp)
+{
+	if (pseudo->type == PSEUDO_VAL) {
+		tmp->state = CCP_CONST;
+		tmp->value = pseudo->value;
+		return tmp;
+	}
+	if ((pseudo->type == PSEUDO_REG || pseudo->type == PSEUDO_PHI) && pseudo->priv)
+		return pseudo->priv;
+	return &varying;
+}
+
+/* Lower the value of what "insn" defines, and look again at its users */
+static void set_value(struct instruction *insn, enum ccp_state state, long long value)
+{
+	struct ccp_value *cell = insn->target->priv;
+	struct pseudo_user *pu;
+
+	if (cell->state == CCP_VARYING || state == CCP_UNDEF)
+		return;
+	if (cell->state == CCP_CONST) {
+		if (state == CCP_CONST && value == cell->value)
+			return;
+		state = CCP_VARYING;
+	}
+	cell->state = state;
+	cell->value = value;
+	FOR_EACH_USER(insn->target, pu) {
+		queue_insn(pu->insn);
+	} END_FOR_EACH_USER(pu);
+}
+
+static void meet(struct ccp_value *res, struct ccp_value *val)
+{
+	if (res->state == CCP_VARYING || val->state == CCP_UNDEF)
+		return;
+	if (res->state == CCP_UNDEF) {
+		*res = *val;
+		return;
+	}
+	if (val->state == CCP_VARYING || val->value != res->value)
+		res->state = CCP_VARYING;
+}
+
+static void visit_phi(struct instruction *insn)
+{
+	struct ccp_value res = { CCP_UNDEF }, tmp;
+	pseudo_t phi;
+
+	FOR_EACH_PTR(insn->phi_list, phi) {
+		struct instruction *def;
+
+		if (phi == VOID)
+			continue;
+		def = phi->def;
+		if (!is_executable(def->bb))
+			continue;
+		meet(&res, get_value(phi, &tmp));
+	} END_FOR_EACH_PTR(phi);
+	set_value(insn, res.state, res.value);
+}
+
+static void visit_binop(struct instruction *insn)
+{
+	struct ccp_value tmp1, tmp2;
+	struct ccp_value *left = get_value(insn->src1, &tmp1);
+	struct ccp_value *right = get_value(insn->src2, &tmp2);
+	long long res;
+
+	if (left->state == CCP_VARYING || right->state == CCP_VARYING)
+		goto varying;
+	if (left->state == CCP_UNDEF || right->state == CCP_UNDEF)
+		return;
+	switch (insn->opcode) {
+	case OP_SHL: case OP_LSR: case OP_ASR:
+		/* Let simplify_instruction() warn about those */
+		if ((unsigned long long)right->value >= insn->size)
+			goto varying;
+	}
+	if (!eval_binop(insn->opcode, insn->size, left->value, right->value, &res))
+		goto varying;
+	set_value(insn, CCP_CONST, res);
+	return;
+
+varying:
+	set_value(insn, CCP_VARYING, 0);
+}
+
+static void visit_unop(struct instruction *insn, pseudo_t src)
+{
+	struct ccp_value tmp, *val = get_value(src, &tmp);
+	long long res;
+	int ok;
+
+	if (val->state != CCP_CONST) {
+		set_value(insn, val->state, 0);
+		return;
+	}
+	if (insn->opcode == OP_NOT || insn->opcode == OP_NEG)
+		ok = eval_unop(insn->opcode, insn->size, val->value, &res);
+	else
+		ok = eval_cast(insn, val->value, &res);
+	if (ok)
+		set_value(insn, CCP_CONST, res);
+	else
+		set_value(insn, CCP_VARYING, 0);
+}
+
+static void visit_select(struct instruction *insn)
+{
+	struct ccp_value tmp, tmp2, *cond = get_value(insn->src1, &tmp);
+	struct ccp_value res;
+
+	switch (cond->state) {
+	case CCP_UNDEF:
+		return;
+	case CCP_CONST:
+		res = *get_value(cond->value ? insn->src2 : insn->src3, &tmp2);
+		break;
+	default:
+		res = *get_value(insn->src2, &tmp2);
+		meet(&res, get_value(insn->src3, &tmp2));
+		break;
+	}
+	set_value(insn, res.state, res.value);
+}
+
+static void visit_terminator(struct instruction *insn)
+{
+	struct basic_block *bb = insn->bb, *child;
+	struct ccp_value tmp, *cond;
+
+	switch (insn->opcode) {
+	case OP_BR:
+		if (!insn->cond) {
+			mark_executable(insn->bb_true);
+			return;
+		}
+		cond = get_value(insn->cond, &tmp);
+		if (cond->state == CCP_UNDEF)
+			return;
+		if (cond->state == CCP_CONST) {
+			mark_executable(cond->value ? insn->bb_true : insn->bb_false);
+			return;
+		}
+		mark_executable(insn->bb_true);
+		mark_executable(insn->bb_false);
+		return;
+	case OP_SWITCH:
+		cond = get_value(insn->cond, &tmp);
+		if (cond->state == CCP_UNDEF)
+			return;
+		if (cond->state == CCP_CONST) {
+			mark_executable(switch_lookup(insn, cond->value));
+			return;
+		}
+		break;
+	}
+	FOR_EACH_PTR(bb->children, child) {
+		mark_executable(child);
+	} END_FOR_EACH_PTR(child);
+}
+
+static void visit_insn(struct instruction *insn)
+{
+	struct ccp_value tmp, *val;
+
+	switch (insn->opcode) {
+	case OP_TERMINATOR ... OP_TERMINATOR_END:
+		visit_terminator(insn);
+		return;
+	case OP_BINARY ... OP_BINARY_END:
+	case OP_BINCMP ... OP_BINCMP_END:
+		if (insn->size && insn->size <= 64) {
+			visit_binop(insn);
+			return;
+		}
+		break;
+	case OP_NOT: case OP_NEG:
+		if (insn->size && insn->size <= 64) {
+			visit_unop(insn, insn->src1);
+			return;
+		}
+		break;
+	case OP_CAST: case OP_SCAST:
+		if (insn->size && insn->size <= 64 && insn->orig_type &&
+		    insn->orig_type->bit_size > 0 && insn->orig_type->bit_size <= 64) {
+			visit_unop(insn, insn->src);
+			return;
+		}
+		break;
+	case OP_SEL:
+		visit_select(insn);
+		return;
+	case OP_PHI:
+		visit_phi(insn);
+		return;
+	case OP_PHISOURCE:
+		if (insn->phi_src == VOID)
+			break;
+		val = get_value(insn->phi_src, &tmp);
+		set_value(insn, val->state, val->value);
+		return;
+	}
+	if (defines(insn))
+		set_value(insn, CCP_VARYING, 0);
+}
+
+static void visit_bb(struct basic_block *bb)
+{
+	struct instruction *insn;
+	struct basic_block *child;
+
+	FOR_EACH_PTR(bb->insns, insn) {
+		if (insn->bb)
+			visit_insn(insn);
+	} END_FOR_EACH_PTR(insn);
+	if (bb_terminated(bb))
+		return;
+	FOR_EACH_PTR(bb->children, child) {
+		mark_executable(child);
+	} END_FOR_EACH_PTR(child);
+}
+
+static void solve(void)
+{
+	while (bb_nr || insn_nr) {
+		if (bb_nr) {
+			visit_bb(bb_work[--bb_nr]);
+			continue;
+		}
+		visit_insn(insn_work[--insn_nr]);
+	}
+}
+
+/*
+ * A branch on something still undefined once everything is known
+ * (an uninitialized variable, say) can go anywhere.
+ */
+static int undefined_branches(struct entrypoint *ep)
+{
+	struct basic_block *bb, *child;
+	struct ccp_value tmp;
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *br = last_instruction(bb->insns);
+
+		if (!is_executable(bb) || !br || !br->bb)
+			continue;
+		if (br->opcode != OP_BR && br->opcode != OP_SWITCH)
+			continue;
+		if (!br->cond || get_value(br->cond, &tmp)->state != CCP_UNDEF)
+			continue;
+		FOR_EACH_PTR(bb->children, child) {
+			mark_executable(child);
+		} END_FOR_EACH_PTR(child);
+	} END_FOR_EACH_PTR(bb);
+	return bb_nr;
+}
+
+/* Replace the constant pseudos, and the branches on them */
+static int apply_constants(struct entrypoint *ep, struct ccp_value *values, int nr)
+{
+	struct basic_block *bb;
+	int i, changed = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct ccp_value *val = &values[i];
+		struct instruction *insn = val->pseudo->def;
+
+		val->pseudo->priv = NULL;
+		if (val->state != CCP_CONST || !val->pseudo->users)
+			continue;
+		/* The phi-nodes will go, and their sources with them */
+		if (insn->opcode == OP_PHISOURCE)
+			continue;
+		convert_instruction_target(insn, value_pseudo(val->value));
+		changed = 1;
+	}
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *br = last_instruction(bb->insns);
+		struct basic_block *target;
+
+		if (!br || !br->bb || !is_executable(bb) || !br->cond || br->cond->type != PSEUDO_VAL)
+			continue;
+		if (br->opcode == OP_BR)
+			target = br->cond->value ? br->bb_true : br->bb_false;
+		else if (br->opcode == OP_SWITCH)
+			target = switch_lookup(br, br->cond->value);
+		else
+			continue;
+		if (!target)
+			continue;
+		insert_branch(bb, br, target);
+		changed = 2;
+	} END_FOR_EACH_PTR(bb);
+	if (changed == 2)
+		kill_unreachable_bbs(ep);
+	return changed;
+}
+
+/*
+ * Returns REPEAT_CSE if some pseudo turned out to be a constant or
+ * some branch could only go one way.
+ */
+int simplify_constants(struct entrypoint *ep)
+{
+	struct ccp_value *values;
+	struct basic_block *bb;
+	int nr = 0, nr_bbs = 0, changed;
+
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *insn;
+
+		nr_bbs++;
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (insn->bb && defines(insn))
+				nr++;
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(bb);
+
+	values = alloc_ccp(nr + 1, sizeof(*values));
+	nr = 0;
+	FOR_EACH_PTR(ep->bbs, bb) {
+		struct instruction *insn;
+
+		FOR_EACH_PTR(bb->insns, insn) {
+			if (insn->bb && defines(insn)) {
+				values[nr].pseudo = insn->target;
+				insn->target->priv = &values[nr++];
+			}
+		} END_FOR_EACH_PTR(insn);
+	} END_FOR_EACH_PTR(bb);
+
+	bb_work = alloc_ccp(nr_bbs + 1, sizeof(*bb_work));
+	bb_nr = 0;
+	executable = ++bb_generation;
+	mark_executable(ep->entry->bb);
+	do {
+		solve();
+	} while (undefined_branches(ep));
+	free(bb_work);
+
+	changed = apply_constants(ep, values, nr);
+	free(values);
+	return changed ? REPEAT_CSE : 0;
+}
@@ -112,6 +112,36 @@ void new_file_scope(void)
 	start_file_scope();
 }
 
+/*
+ * Remember how much of the global scope survives between
+ * translation units, see rollback_global_scope().
+ */
+static int global_scope_mark;
+
+void mark_global_scope(void)
+{
+	global_scope_mark = ptr_list_size((struct ptr_list *)global_scope->symbols);
+}
+
+/*
+ * Forget everything the current translation unit has bound:
+ * its file scope and whatever it added to the global scope.
+ */
+void rollback_global_scope(void)
+{
+	int nr;
+
+	if (file_scope != &builtin_scope)
+		end_file_scope();
+	function_scope = block_scope = file_scope;
+
+	nr = ptr_list_size((struct ptr_list *)global_scope->symbols);
+	while (nr-- > global_scope_mark) {
+		struct symbol *sym = delete_ptr_list_last((struct ptr_list **)&global_scope->symbols);
+		remove_symbol_scope(sym);
+	}
+}
+
 void end_symbol_scope(void)
 {
 	end_scope(&block_scope);
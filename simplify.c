@@ -147,38 +147,39 @@ static int clean_up_phi(struct instruction *insn)
 	return if_convert_phi(insn);
 }
 
-static int delete_pseudo_user_list_entry(struct pseudo_user_list **list, pseudo_t *entry, int count)
+/*
+ * Find the use of "p" through "usep" among the few uses "insn"
+ * makes, and unlink it from both chains.
+ */
+static void delete_pseudo_user(struct instruction *insn, pseudo_t p, pseudo_t *usep)
 {
-	struct pseudo_user *pu;
+	struct pseudo_user **up, *pu;
 
-	FOR_EACH_PTR(*list, pu) {
-		if (pu->userp == entry) {
-			DELETE_CURRENT_PTR(pu);
-			if (!--count)
-				goto out;
+	for (up = &insn->uses; (pu = *up) != NULL; up = &pu->next_use) {
+		if (pu->userp == usep && pu->pseudo == p) {
+			*up = pu->next_use;
+			unlink_pseudo_user(pu);
+			return;
 		}
-	} END_FOR_EACH_PTR(pu);
-	assert(count <= 0);
-out:
-	pack_ptr_list((struct ptr_list **)list);
-	return count;
+	}
+	assert(0);
 }
 
-static inline void remove_usage(pseudo_t p, pseudo_t *usep)
+static inline void remove_usage(struct instruction *insn, pseudo_t p, pseudo_t *usep)
 {
 	if (has_use_list(p)) {
-		delete_pseudo_user_list_entry(&p->users, usep, 1);
+		delete_pseudo_user(insn, p, usep);
 		if (!p->users)
 			kill_instruction(p->def);
 	}
 }
 
-void kill_use(pseudo_t *usep)
+void kill_use(struct instruction *insn, pseudo_t *usep)
 {
 	if (usep) {
 		pseudo_t p = *usep;
 		*usep = VOID;
-		remove_usage(p, usep);
+		remove_usage(insn, p, usep);
 	}
 }
 
@@ -190,14 +191,14 @@ void kill_instruction(struct instruction *insn)
 	switch (insn->opcode) {
 	case OP_BINARY ... OP_BINCMP_END:
 		insn->bb = NULL;
-		kill_use(&insn->src1);
-		kill_use(&insn->src2);
+		kill_use(insn, &insn->src1);
+		kill_use(insn, &insn->src2);
 		repeat_phase |= REPEAT_CSE;
 		return;
 
 	case OP_NOT: case OP_NEG:
 		insn->bb = NULL;
-		kill_use(&insn->src1);
+		kill_use(insn, &insn->src1);
 		repeat_phase |= REPEAT_CSE;
 		return;
 
@@ -214,15 +215,15 @@ void kill_instruction(struct instruction *insn)
 	case OP_RANGE:
 		insn->bb = NULL;
 		repeat_phase |= REPEAT_CSE;
-		kill_use(&insn->src1);
-		kill_use(&insn->src2);
-		kill_use(&insn->src3);
+		kill_use(insn, &insn->src1);
+		kill_use(insn, &insn->src2);
+		kill_use(insn, &insn->src3);
 		return;
 	case OP_BR:
 		insn->bb = NULL;
 		repeat_phase |= REPEAT_CSE;
 		if (insn->cond)
-			kill_use(&insn->cond);
+			kill_use(insn, &insn->cond);
 		return;
 	}
 }
@@ -233,15 +234,15 @@ void kill_instruction(struct instruction *insn)
 static int dead_insn(struct instruction *insn, pseudo_t *src1, pseudo_t *src2, pseudo_t *src3)
 {
 	struct pseudo_user *pu;
-	FOR_EACH_PTR(insn->target->users, pu) {
+	FOR_EACH_USER(insn->target, pu) {
 		if (*pu->userp != VOID)
 			return 0;
-	} END_FOR_EACH_PTR(pu);
+	} END_FOR_EACH_USER(pu);
 
 	insn->bb = NULL;
-	kill_use(src1);
-	kill_use(src2);
-	kill_use(src3);
+	kill_use(insn, src1);
+	kill_use(insn, src2);
+	kill_use(insn, src3);
 	return REPEAT_CSE;
 }
 
@@ -302,7 +303,8 @@ static int simplify_asr(struct instruction *insn, pseudo_t pseudo, long long val
 	unsigned int size = operand_size(insn, pseudo);
 
 	if (value >= size) {
-		warning(insn->pos, "right shift by bigger than source value");
+		if (Wlinearize)
+			warning(insn->pos, "right shift by bigger than source value");
 		return replace_with_pseudo(insn, value_pseudo(0));
 	}
 	if (!value)
@@ -367,15 +369,17 @@ static int simplify_constant_leftside(struct instruction *insn)
 	return 0;
 }
 
-static int simplify_constant_binop(struct instruction *insn)
+/*
+ * The value of a binop on two constants, in "*res". Returns 0 if
+ * it can't be folded (a division by zero, say).
+ */
+int eval_binop(int opcode, unsigned int size, long long left, long long right, long long *res)
 {
 	/* FIXME! Verify signs and sizes!! */
-	long long left = insn->src1->value;
-	long long right = insn->src2->value;
 	unsigned long long ul, ur;
-	long long res, mask, bits;
+	long long mask, bits;
 
-	mask = 1ULL << (insn->size-1);
+	mask = 1ULL << (size-1);
 	bits = mask | (mask-1);
 
 	if (left & mask)
@@ -385,105 +389,113 @@ static int simplify_constant_binop(struct instruction *insn)
 	ul = left & bits;
 	ur = right & bits;
 
-	switch (insn->opcode) {
+	switch (opcode) {
 	case OP_ADD:
-		res = left + right;
+		*res = left + right;
 		break;
 	case OP_SUB:
-		res = left - right;
+		*res = left - right;
 		break;
 	case OP_MULU:
-		res = ul * ur;
+		*res = ul * ur;
 		break;
 	case OP_MULS:
-		res = left * right;
+		*res = left * right;
 		break;
 	case OP_DIVU:
 		if (!ur)
 			return 0;
-		res = ul / ur;
+		*res = ul / ur;
 		break;
 	case OP_DIVS:
 		if (!right)
 			return 0;
 		if (left == mask && right == -1)
 			return 0;
-		res = left / right;
+		*res = left / right;
 		break;
 	case OP_MODU:
 		if (!ur)
 			return 0;
-		res = ul % ur;
+		*res = ul % ur;
 		break;
 	case OP_MODS:
 		if (!right)
 			return 0;
 		if (left == mask && right == -1)
 			return 0;
-		res = left % right;
+		*res = left % right;
 		break;
 	case OP_SHL:
-		res = left << right;
+		*res = left << right;
 		break;
 	case OP_LSR:
-		res = ul >> ur;
+		*res = ul >> ur;
 		break;
 	case OP_ASR:
-		res = left >> right;
+		*res = left >> right;
 		break;
        /* Logical */
 	case OP_AND:
-		res = left & right;
+		*res = left & right;
 		break;
 	case OP_OR:
-		res = left | right;
+		*res = left | right;
 		break;
 	case OP_XOR:
-		res = left ^ right;
+		*res = left ^ right;
 		break;
 	case OP_AND_BOOL:
-		res = left && right;
+		*res = left && right;
 		break;
 	case OP_OR_BOOL:
-		res = left || right;
+		*res = left || right;
 		break;
 			       
 	/* Binary comparison */
 	case OP_SET_EQ:
-		res = left == right;
+		*res = left == right;
 		break;
 	case OP_SET_NE:
-		res = left != right;
+		*res = left != right;
 		break;
 	case OP_SET_LE:
-		res = left <= right;
+		*res = left <= right;
 		break;
 	case OP_SET_GE:
-		res = left >= right;
+		*res = left >= right;
 		break;
 	case OP_SET_LT:
-		res = left < right;
+		*res = left < right;
 		break;
 	case OP_SET_GT:
-		res = left > right;
+		*res = left > right;
 		break;
 	case OP_SET_B:
-		res = ul < ur;
+		*res = ul < ur;
 		break;
 	case OP_SET_A:
-		res = ul > ur;
+		*res = ul > ur;
 		break;
 	case OP_SET_BE:
-		res = ul <= ur;
+		*res = ul <= ur;
 		break;
 	case OP_SET_AE:
-		res = ul >= ur;
+		*res = ul >= ur;
 		break;
 	default:
 		return 0;
 	}
-	res &= bits;
+	*res &= bits;
+	return 1;
+}
 
+static int simplify_constant_binop(struct instruction *insn)
+{
+	long long res;
+
+	if (!eval_binop(insn->opcode, insn->size, insn->src1->value, insn->src2->value, &res))
+		return 0;
 	replace_with_pseudo(insn, value_pseudo(res));
 	return REPEAT_CSE;
 }
@@ -508,8 +520,8 @@ static void switch_pseudo(struct instruction *insn1, pseudo_t *pp1, struct instr
 
 	use_pseudo(insn1, p2, pp1);
 	use_pseudo(insn2, p1, pp2);
-	remove_usage(p1, pp1);
-	remove_usage(p2, pp2);
+	remove_usage(insn1, p1, pp1);
+	remove_usage(insn2, p2, pp2);
 }
 
 static int canonical_order(pseudo_t p1, pseudo_t p2)
@@ -554,30 +566,37 @@ static int simplify_associative_binop(struct instruction *insn)
 		return 0;
 	if (!simple_pseudo(def->src2))
 		return 0;
-	if (ptr_list_size((struct ptr_list *)def->target->users) != 1)
+	if (!has_one_user(def->target))
 		return 0;
 	switch_pseudo(def, &def->src1, insn, &insn->src2);
 	return REPEAT_CSE;
 }
 
-static int simplify_constant_unop(struct instruction *insn)
+int eval_unop(int opcode, unsigned int size, long long val, long long *res)
 {
-	long long val = insn->src1->value;
-	long long res, mask;
+	long long mask;
 
-	switch (insn->opcode) {
+	switch (opcode) {
 	case OP_NOT:
-		res = ~val;
+		*res = ~val;
 		break;
 	case OP_NEG:
-		res = -val;
+		*res = -val;
 		break;
 	default:
 		return 0;
 	}
-	mask = 1ULL << (insn->size-1);
-	res &= mask | (mask-1);
-	
+	mask = 1ULL << (size-1);
+	*res &= mask | (mask-1);
+	return 1;
+}
+
+static int simplify_constant_unop(struct instruction *insn)
+{
+	long long res;
+
+	if (!eval_unop(insn->opcode, insn->size, insn->src1->value, &res))
+		return 0;
 	replace_with_pseudo(insn, value_pseudo(res));
 	return REPEAT_CSE;
 }
@@ -599,7 +618,7 @@ static int simplify_one_memop(struct instruction *insn, pseudo_t orig)
 	if (addr->type == PSEUDO_REG) {
 		struct instruction *def = addr->def;
 		if (def->opcode == OP_SYMADDR && def->src) {
-			kill_use(&insn->src);
+			kill_use(insn, &insn->src);
 			use_pseudo(insn, def->src, &insn->src);
 			return REPEAT_CSE | REPEAT_SYMBOL_CLEANUP;
 		}
@@ -623,11 +642,12 @@ offset:
 		if (new == VOID)
 			return 0;
 		new = VOID;
-		warning(insn->pos, "crazy programmer");
+		if (Wlinearize)
+			warning(insn->pos, "crazy programmer");
 	}
 	insn->offset += off->value;
 	use_pseudo(insn, new, &insn->src);
-	remove_usage(addr, &insn->src);
+	remove_usage(insn, addr, &insn->src);
 	return REPEAT_CSE | REPEAT_SYMBOL_CLEANUP;
 }
 
@@ -649,17 +669,31 @@ static int simplify_memop(struct instruction *insn)
 
 static long long get_cast_value(long long val, int old_size, int new_size, int sign)
 {
-	long long mask;
+	unsigned long long mask;
 
-	if (sign && new_size > old_size) {
-		mask = 1 << (old_size-1);
+	if (sign && new_size > old_size && old_size > 0 && old_size < 64) {
+		mask = 1ULL << (old_size-1);
 		if (val & mask)
 			val |= ~(mask | (mask-1));
 	}
-	mask = 1 << (new_size-1);
+	if (new_size <= 0 || new_size >= 64)
+		return val;
+	mask = 1ULL << (new_size-1);
 	return val & (mask | (mask-1));
 }
 
+/* The value of a cast of a constant; 0 if pointers are involved */
+int eval_cast(struct instruction *insn, long long val, long long *res)
+{
+	struct symbol *orig_type = insn->orig_type;
+
+	if (!orig_type || is_ptr_type(orig_type) || is_ptr_type(insn->type))
+		return 0;
+	*res = get_cast_value(val, orig_type->bit_size, insn->size,
+		orig_type->ctype.modifiers & MOD_SIGNED);
+	return 1;
+}
+
 static int simplify_cast(struct instruction *insn)
 {
 	struct symbol *orig_type;
@@ -683,8 +717,9 @@ static int simplify_cast(struct instruction *insn)
 
 	/* A cast of a constant? */
 	if (constant(src)) {
-		int sign = orig_type->ctype.modifiers & MOD_SIGNED;
-		long long val = get_cast_value(src->value, orig_size, size, sign);
+		long long val;
+
+		eval_cast(insn, src->value, &val);
 		src = value_pseudo(val);
 		goto simplify;
 	}
@@ -726,10 +761,10 @@ static int simplify_select(struct instruction *insn)
 	src2 = insn->src3;
 	if (constant(cond) || src1 == src2) {
 		pseudo_t *kill, take;
-		kill_use(&insn->src1);
+		kill_use(insn, &insn->src1);
 		take = cond->value ? src1 : src2;
 		kill = cond->value ? &insn->src3 : &insn->src2;
-		kill_use(kill);
+		kill_use(insn, kill);
 		replace_with_pseudo(insn, take);
 		return REPEAT_CSE;
 	}
@@ -788,7 +823,7 @@ static int simplify_range(struct instruction *insn)
 static int simplify_cond_branch(struct instruction *br, pseudo_t cond, struct instruction *def, pseudo_t *pp)
 {
 	use_pseudo(br, *pp, &br->cond);
-	remove_usage(cond, &br->cond);
+	remove_usage(br, cond, &br->cond);
 	if (def->opcode == OP_SET_EQ) {
 		struct basic_block *true = br->bb_true;
 		struct basic_block *false = br->bb_false;
@@ -818,7 +853,7 @@ static int simplify_branch(struct instruction *insn)
 		remove_bb_from_list(&target->parents, bb, 1);
 		remove_bb_from_list(&bb->children, target, 1);
 		insn->bb_false = NULL;
-		kill_use(&insn->cond);
+		kill_use(insn, &insn->cond);
 		insn->cond = NULL;
 		return REPEAT_CSE;
 	}
@@ -852,7 +887,7 @@ static int simplify_branch(struct instruction *insn)
 					insn->bb_true = false;
 				}
 				use_pseudo(insn, def->src1, &insn->cond);
-				remove_usage(cond, &insn->cond);
+				remove_usage(insn, cond, &insn->cond);
 				return REPEAT_CSE;
 			}
 		}
@@ -860,7 +895,7 @@ static int simplify_branch(struct instruction *insn)
 			int orig_size = def->orig_type ? def->orig_type->bit_size : 0;
 			if (def->size > orig_size) {
 				use_pseudo(insn, def->src, &insn->cond);
-				remove_usage(cond, &insn->cond);
+				remove_usage(insn, cond, &insn->cond);
 				return REPEAT_CSE;
 			}
 		}
@@ -871,25 +906,18 @@ static int simplify_branch(struct instruction *insn)
 static int simplify_switch(struct instruction *insn)
 {
 	pseudo_t cond = insn->cond;
-	long long val;
-	struct multijmp *jmp;
+	struct basic_block *target;
 
 	if (!constant(cond))
 		return 0;
-	val = insn->cond->value;
-
-	FOR_EACH_PTR(insn->multijmp_list, jmp) {
-		/* Default case */
-		if (jmp->begin > jmp->end)
-			goto found;
-		if (val >= jmp->begin && val <= jmp->end)
-			goto found;
-	} END_FOR_EACH_PTR(jmp);
-	warning(insn->pos, "Impossible case statement");
-	return 0;
 
-found:
-	insert_branch(insn->bb, insn, jmp->target);
+	target = switch_lookup(insn, cond->value);
+	if (!target) {
+		if (Wlinearize)
+			warning(insn->pos, "Impossible case statement");
+		return 0;
+	}
+	insert_branch(insn->bb, insn, target);
 	return REPEAT_CSE;
 }
 
@@ -222,6 +222,54 @@ merge_block_seqs (struct ptr_list *b1, int n,
 }
 
 
+// Vector blocks can be far bigger than the merge buffer above,
+// so lists that have any are sorted as a flat array instead: runs
+// of LIST_NODE_NR are sorted in place, then merged pairwise.
+static void sort_vector_list(struct ptr_list *head,
+			     int (*cmp)(const void *, const void *))
+{
+	int nr = ptr_list_size(head), width, i;
+	void **base, **arr, **tmp, **swap;
+	struct ptr_list *list = head;
+
+	base = malloc(2 * nr * sizeof(void *));
+	if (!base)
+		die("out of memory");
+	arr = base;
+	tmp = base + nr;
+	linearize_ptr_list(head, arr, nr);
+
+	for (i = 0; i < nr; i += LIST_NODE_NR)
+		array_sort(arr + i, nr - i < LIST_NODE_NR ? nr - i : LIST_NODE_NR, cmp);
+
+	for (width = LIST_NODE_NR; width < nr; width *= 2) {
+		for (i = 0; i < nr; i += 2 * width) {
+			int l = i, k = i;
+			int m = i + width < nr ? i + width : nr;
+			int h = i + 2 * width < nr ? i + 2 * width : nr;
+			int r = m;
+
+			while (l < m && r < h)
+				tmp[k++] = cmp(arr[l], arr[r]) <= 0 ? arr[l++] : arr[r++];
+			while (l < m)
+				tmp[k++] = arr[l++];
+			while (r < h)
+				tmp[k++] = arr[r++];
+		}
+		swap = arr;
+		arr = tmp;
+		tmp = swap;
+	}
+
+	i = 0;
+	do {
+		memcpy(list->list, arr + i, list->nr * sizeof(void *));
+		i += list->nr;
+		list = list->next;
+	} while (list != head);
+	free(base);
+}
+
 void sort_list(struct ptr_list **plist, int (*cmp)(const void *, const void *))
 {
 	struct ptr_list *head = *plist, *list = head;
@@ -230,6 +278,14 @@ void sort_list(struct ptr_list **plist, int (*cmp)(const void *, const void *))
 	if (!head)
 		return;
 
+	do {
+		if (list->size) {
+			sort_vector_list(head, cmp);
+			return;
+		}
+		list = list->next;
+	} while (list != head);
+
 	// Sort all the sub-lists
 	do {
 		array_sort(list->list, list->nr, cmp);
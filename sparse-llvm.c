@@ -7,6 +7,7 @@
 #include <llvm-c/BitWriter.h>
 #include <llvm-c/Analysis.h>
 #include <llvm-c/Target.h>
+#include <llvm/Config/llvm-config.h>
 
 #include <stdbool.h>
 #include <stdio.h>
@@ -318,7 +319,7 @@ static LLVMValueRef pseudo_to_value(struct function *fn, struct instruction *ins
 		assert(sym->bb_target == NULL);
 
 		expr = sym->initializer;
-		if (expr) {
+		if (expr && expr->type != EXPR_INITIALIZER) {
 			switch (expr->type) {
 			case EXPR_STRING: {
 				const char *s = expr->string->data;
@@ -621,6 +622,71 @@ static void output_op_store(struct function *fn, struct instruction *insn)
 	insn->target->priv = target;
 }
 
+/* The bytes of a constant initializer, NULL if it isn't one */
+static LLVMValueRef const_data(struct expression *init, unsigned int size)
+{
+	unsigned char *data = malloc(size);
+	LLVMValueRef value = NULL;
+
+	if (!data)
+		die("out of memory");
+	if (initializer_bytes(init, data, size))
+		value = LLVMConstString((const char *) data, size, true);
+	free(data);
+	return value;
+}
+
+/*
+ * LLVM 7 dropped the alignment argument of llvm.memcpy, and since
+ * LLVM 8 the builder knows how to call it for us.
+ */
+#if LLVM_VERSION_MAJOR >= 8
+static void build_memcpy(struct function *fn, LLVMValueRef dst, LLVMValueRef src, unsigned int size)
+{
+	LLVMBuildMemCpy(fn->builder, dst, 1, src, 1, LLVMConstInt(LLVMInt64Type(), size, 0));
+}
+#else
+static void build_memcpy(struct function *fn, LLVMValueRef dst, LLVMValueRef src, unsigned int size)
+{
+	static const char name[] = "llvm.memcpy.p0i8.p0i8.i64";
+	LLVMTypeRef bytep = LLVMPointerType(LLVMInt8Type(), 0);
+#if LLVM_VERSION_MAJOR >= 7
+	LLVMTypeRef params[] = { bytep, bytep, LLVMInt64Type(), LLVMInt1Type() };
+#else
+	LLVMTypeRef params[] = { bytep, bytep, LLVMInt64Type(), LLVMInt32Type(), LLVMInt1Type() };
+#endif
+	LLVMValueRef copy, args[ARRAY_SIZE(params)];
+	int n = 0;
+
+	copy = LLVMGetNamedFunction(fn->module, name);
+	if (!copy)
+		copy = LLVMAddFunction(fn->module, name,
+			LLVMFunctionType(LLVMVoidType(), params, ARRAY_SIZE(params), 0));
+
+	args[n++] = LLVMBuildPointerCast(fn->builder, dst, bytep, "");
+	args[n++] = LLVMBuildPointerCast(fn->builder, src, bytep, "");
+	args[n++] = LLVMConstInt(LLVMInt64Type(), size, 0);
+#if LLVM_VERSION_MAJOR < 7
+	args[n++] = LLVMConstInt(LLVMInt32Type(), 1, 0);
+#endif
+	args[n++] = LLVMConstInt(LLVMInt1Type(), 0, 0);
+	LLVMBuildCall(fn->builder, copy, args, n, "");
+}
+#endif
+
+static void output_op_init(struct function *fn, struct instruction *insn)
+{
+	unsigned int size = insn->size / 8;
+	LLVMValueRef data;
+
+	data = LLVMAddGlobal(fn->module, LLVMArrayType(LLVMInt8Type(), size), ".init");
+	LLVMSetLinkage(data, LLVMPrivateLinkage);
+	LLVMSetGlobalConstant(data, 1);
+	LLVMSetInitializer(data, const_data(insn->val, size));
+
+	build_memcpy(fn, pseudo_to_value(fn, insn, insn->src), data, size);
+}
+
 static LLVMValueRef bool_value(struct function *fn, LLVMValueRef value)
 {
 	if (LLVMTypeOf(value) != LLVMInt1Type())
@@ -657,33 +723,70 @@ static void output_op_sel(struct function *fn, struct instruction *insn)
 	insn->target->priv = target;
 }
 
+/* Bigger ranges are checked by a pair of compares rather than case by case */
+#define MAX_RANGE_CASES	16
+
+static int range_is_big(struct multijmp *jmp)
+{
+	return (long long)jmp->end - jmp->begin >= MAX_RANGE_CASES;
+}
+
 static void output_op_switch(struct function *fn, struct instruction *insn)
 {
+	LLVMBasicBlockRef bb, def;
 	LLVMValueRef sw_val, target;
-	struct basic_block *def = NULL;
+	LLVMTypeRef type;
+	struct switch_info info;
 	struct multijmp *jmp;
-	int n_jmp = 0;
-
-	FOR_EACH_PTR(insn->multijmp_list, jmp) {
-		if (jmp->begin == jmp->end) {		/* case N */
-			n_jmp++;
-		} else if (jmp->begin < jmp->end) {	/* case M..N */
-			assert(0);
-		} else					/* default case */
-			def = jmp->target;
-	} END_FOR_EACH_PTR(jmp);
+	unsigned nr = 0;
 
+	get_switch_info(insn, &info);
 	sw_val = pseudo_to_value(fn, insn, insn->target);
-	target = LLVMBuildSwitch(fn->builder, sw_val,
-				 def ? def->priv : NULL, n_jmp);
+	type = LLVMTypeOf(sw_val);
+	def = info.def ? info.def->priv : NULL;
 
+	/*
+	 * No ranges in LLVM: the big ones are chained in front of the
+	 * default, each in its own block, before the switch is built.
+	 */
+	bb = LLVMGetInsertBlock(fn->builder);
+	FOR_EACH_PTR_REVERSE(insn->multijmp_list, jmp) {
+		LLVMBasicBlockRef check;
+		LLVMValueRef lo, hi;
+
+		if (jmp->begin > jmp->end)
+			continue;
+		if (!range_is_big(jmp)) {
+			nr += jmp->end - jmp->begin + 1;
+			continue;
+		}
+		if (!def) {
+			def = LLVMAppendBasicBlock(fn->fn, "nocase");
+			LLVMPositionBuilderAtEnd(fn->builder, def);
+			LLVMBuildUnreachable(fn->builder);
+		}
+		check = LLVMAppendBasicBlock(fn->fn, "range");
+		LLVMPositionBuilderAtEnd(fn->builder, check);
+		lo = LLVMBuildICmp(fn->builder, LLVMIntSGE, sw_val,
+				   LLVMConstInt(type, jmp->begin, 1), "");
+		hi = LLVMBuildICmp(fn->builder, LLVMIntSLE, sw_val,
+				   LLVMConstInt(type, jmp->end, 1), "");
+		LLVMBuildCondBr(fn->builder, LLVMBuildAnd(fn->builder, lo, hi, ""),
+				jmp->target->priv, def);
+		def = check;
+	} END_FOR_EACH_PTR_REVERSE(jmp);
+	LLVMPositionBuilderAtEnd(fn->builder, bb);
+
+	target = LLVMBuildSwitch(fn->builder, sw_val, def, nr);
 	FOR_EACH_PTR(insn->multijmp_list, jmp) {
-		if (jmp->begin == jmp->end) {		/* case N */
+		long long val;
+
+		if (range_is_big(jmp))
+			continue;
+		for (val = jmp->begin; val <= jmp->end; val++) {
 			LLVMAddCase(target,
-				LLVMConstInt(LLVMInt32Type(), jmp->begin, 0),
+				LLVMConstInt(LLVMInt32Type(), val, 0),
 				jmp->target->priv);
-		} else if (jmp->begin < jmp->end) {	/* case M..N */
-			assert(0);
 		}
 	} END_FOR_EACH_PTR(jmp);
 
@@ -852,6 +955,9 @@ static void output_insn(struct function *fn, struct instruction *insn)
 	case OP_STORE:
 		output_op_store(fn, insn);
 		break;
+	case OP_INIT:
+		output_op_init(fn, insn);
+		break;
 	case OP_SNOP:
 		assert(0);
 		break;
@@ -1043,6 +1149,10 @@ static LLVMValueRef output_data(LLVMModuleRef module, struct symbol *sym)
 			initial_value = LLVMConstString(strdup(s), strlen(s) + 1, true);
 			break;
 		}
+		case EXPR_INITIALIZER:
+			initial_value = const_data(initializer, sym->bit_size / 8);
+			assert(initial_value != NULL);
+			break;
 		default:
 			assert(0);
 		}
@@ -39,6 +39,7 @@
 #include "symbol.h"
 #include "expression.h"
 #include "linearize.h"
+#include "flow.h"
 
 static int context_increase(struct basic_block *bb, int entry)
 {
@@ -65,52 +66,88 @@ static int context_increase(struct basic_block *bb, int entry)
 	return sum;
 }
 
-static int imbalance(struct entrypoint *ep, struct basic_block *bb, int entry, int exit, const char *why)
+static void imbalance(struct entrypoint *ep, struct basic_block *bb, const char *why)
 {
 	if (Wcontext) {
 		struct symbol *sym = ep->name;
 		warning(bb->pos, "context imbalance in '%s' - %s", show_ident(sym->ident), why);
 	}
-	return -1;
 }
 
-static int check_bb_context(struct entrypoint *ep, struct basic_block *bb, int entry, int exit);
+struct context_edge {
+	struct basic_block *bb;
+	int entry;
+};
 
-static int check_children(struct entrypoint *ep, struct basic_block *bb, int entry, int exit)
+static struct context_edge *context_stack;
+static int context_top, context_size;
+
+static void push_context(struct basic_block *bb, int entry)
 {
-	struct instruction *insn;
-	struct basic_block *child;
-
-	insn = last_instruction(bb->insns);
-	if (!insn)
-		return 0;
-	if (insn->opcode == OP_RET)
-		return entry != exit ? imbalance(ep, bb, entry, exit, "wrong count at exit") : 0;
-
-	FOR_EACH_PTR(bb->children, child) {
-		if (check_bb_context(ep, child, entry, exit))
-			return -1;
-	} END_FOR_EACH_PTR(child);
-	return 0;
+	if (context_top == context_size) {
+		context_size = context_size ? context_size * 2 : 64;
+		context_stack = realloc(context_stack, context_size * sizeof(*context_stack));
+		if (!context_stack)
+			die("out of memory");
+	}
+	context_stack[context_top].bb = bb;
+	context_stack[context_top].entry = entry;
+	context_top++;
 }
 
-static int check_bb_context(struct entrypoint *ep, struct basic_block *bb, int entry, int exit)
+/*
+ * Give every bb the context it is entered with. The first way we
+ * find into a bb decides it, and all the other ways in have to
+ * agree: so each bb is only walked once, with an explicit stack,
+ * however deep the flow graph. An imbalance only stops the walk
+ * down that path, so that all of them get reported, once per bb.
+ */
+static void check_bb_context(struct entrypoint *ep, int entry, int exit)
 {
-	if (!bb)
-		return 0;
-	if (bb->context == entry)
-		return 0;
+	unsigned long reported = ++bb_generation;
 
-	/* Now that's not good.. */
-	if (bb->context >= 0)
-		return imbalance(ep, bb, entry, bb->context, "different lock contexts for basic block");
+	push_context(ep->entry->bb, entry);
+	while (context_top) {
+		struct context_edge *edge = &context_stack[--context_top];
+		struct basic_block *bb = edge->bb, *child;
+		struct instruction *insn;
+		int context = edge->entry;
 
-	bb->context = entry;
-	entry += context_increase(bb, entry);
-	if (entry < 0)
-		return imbalance(ep, bb, entry, exit, "unexpected unlock");
+		if (bb->context == context || bb->generation == reported)
+			continue;
+
+		/* Now that's not good.. */
+		if (bb->context >= 0) {
+			imbalance(ep, bb, "different lock contexts for basic block");
+			bb->generation = reported;
+			continue;
+		}
+
+		bb->context = context;
+		context += context_increase(bb, context);
+		if (context < 0) {
+			imbalance(ep, bb, "unexpected unlock");
+			bb->generation = reported;
+			continue;
+		}
 
-	return check_children(ep, bb, entry, exit);
+		insn = last_instruction(bb->insns);
+		if (!insn)
+			continue;
+		if (insn->opcode == OP_RET) {
+			if (context != exit) {
+				imbalance(ep, bb, "wrong count at exit");
+				bb->generation = reported;
+			}
+			continue;
+		}
+
+		/* Walk the first child first */
+		FOR_EACH_PTR_REVERSE(bb->children, child) {
+			if (child)
+				push_context(child, context);
+		} END_FOR_EACH_PTR_REVERSE(child);
+	}
 }
 
 static void check_cast_instruction(struct instruction *insn)
@@ -174,6 +211,8 @@ static pseudo_t argument(struct instruction *call, unsigned int argno)
 
 static void check_memset(struct instruction *insn)
 {
+	if (!Wmemcpy_max_count)
+		return;
 	check_byte_count(insn, argument(insn, 3));
 }
 
@@ -247,20 +286,26 @@ static void check_instructions(struct entrypoint *ep)
 	} END_FOR_EACH_PTR(bb);
 }
 
+static void check_uninitialized(struct entrypoint *ep)
+{
+	struct symbol *sym = ep->name;
+	pseudo_t pseudo;
+
+	FOR_EACH_PTR(ep->entry->bb->needs, pseudo) {
+		if (pseudo->type != PSEUDO_ARG)
+			warning(sym->pos, "%s: possible uninitialized variable (%s)",
+				show_ident(sym->ident), show_pseudo(pseudo));
+	} END_FOR_EACH_PTR(pseudo);
+}
+
 static void check_context(struct entrypoint *ep)
 {
 	struct symbol *sym = ep->name;
 	struct context *context;
 	unsigned int in_context = 0, out_context = 0;
 
-	if (Wuninitialized && verbose && ep->entry->bb->needs) {
-		pseudo_t pseudo;
-		FOR_EACH_PTR(ep->entry->bb->needs, pseudo) {
-			if (pseudo->type != PSEUDO_ARG)
-				warning(sym->pos, "%s: possible uninitialized variable (%s)",
-					show_ident(sym->ident), show_pseudo(pseudo));
-		} END_FOR_EACH_PTR(pseudo);
-	}
+	if (Wuninitialized && verbose)
+		check_uninitialized(ep);
 
 	check_instructions(ep);
 
@@ -268,23 +313,93 @@ static void check_context(struct entrypoint *ep)
 		in_context += context->in;
 		out_context += context->out;
 	} END_FOR_EACH_PTR(context);
-	check_bb_context(ep, ep->entry->bb, in_context, out_context);
+	check_bb_context(ep, in_context, out_context);
+}
+
+static int always(void)
+{
+	return 1;
+}
+
+static int uninitialized_enabled(void)
+{
+	return Wuninitialized && verbose;
+}
+
+static int cast_enabled(void)
+{
+	return verbose;
+}
+
+static int linearize_enabled(void)
+{
+	return Wlinearize;
+}
+
+static int byte_count_enabled(void)
+{
+	return Wmemcpy_max_count;
+}
+
+/*
+ * The checks done on the linearized code, with what turns them on
+ * and what a function has to contain (FOUND_*, from expand) for them
+ * to have anything to say about it; 0 is any function.
+ */
+static const struct ir_check {
+	int (*enabled)(void);
+	unsigned int needs;
+} ir_checks[] = {
+	{ always, FOUND_CONTEXT },		/* check_bb_context() */
+	{ always, FOUND_RANGE },		/* check_range_instruction() */
+	{ byte_count_enabled, FOUND_CALL },	/* check_byte_count() */
+	{ uninitialized_enabled, 0 },		/* check_uninitialized() */
+	{ cast_enabled, 0 },			/* check_cast_instruction() */
+	{ linearize_enabled, 0 },		/* flow.c and simplify.c */
+	{ always, FOUND_ASM | FOUND_INVALID },	/* linearize_symbol() itself */
+};
+
+/*
+ * What a function must contain to be worth linearizing, given the
+ * checks that are on: FOUND_ANY for all of them, 0 for none.
+ */
+#define FOUND_ANY	(~0U)
+
+static unsigned int ir_needs(void)
+{
+	unsigned int needs = 0;
+	int i;
+
+	if (dbg_entry || dump_pass_stats)
+		return FOUND_ANY;
+	for (i = 0; i < ARRAY_SIZE(ir_checks); i++) {
+		if (!ir_checks[i].enabled())
+			continue;
+		if (!ir_checks[i].needs)
+			return FOUND_ANY;
+		needs |= ir_checks[i].needs;
+	}
+	return needs;
 }
 
 static void check_symbols(struct symbol_list *list)
 {
+	unsigned int needs = ir_needs();
 	struct symbol *sym;
 
 	FOR_EACH_PTR(list, sym) {
 		struct entrypoint *ep;
 
 		expand_symbol(sym);
+		if (needs != FOUND_ANY && !(expand_found & needs))
+			continue;
 		ep = linearize_symbol(sym);
 		if (ep) {
 			if (dbg_entry)
 				show_entry(ep);
 
 			check_context(ep);
+			free_entrypoint(ep);
 		}
 	} END_FOR_EACH_PTR(sym);
 }
@@ -296,8 +411,14 @@ int main(int argc, char **argv)
 
 	// Expand, linearize and show it.
 	check_symbols(sparse_initialize(argc, argv, &filelist));
+	if (per_file_memory)
+		sparse_checkpoint();
 	FOR_EACH_PTR_NOTAG(filelist, file) {
 		check_symbols(sparse(file));
+		if (per_file_memory)
+			sparse_rollback();
 	} END_FOR_EACH_PTR_NOTAG(file);
+	show_mem_report();
+	show_all_pass_stats();
 	return 0;
 }
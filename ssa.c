@@ -0,0 +1,244 @@
+/*
+ * SSA - turn a local variable into pseudos the way Cytron et al.
+ * do it: put phi-nodes on the iterated dominance frontier of the
+ * stores (only where the variable is live), then walk the dominator
+ * tree replacing each load by the value reaching it.
+ *
+ * This is the -fcytron-ssa alternative to searching back from each
+ * load for the stores dominating it (see simplify_one_symbol()). It
+ * only handles locals whose address isn't taken and that are always
+ * accessed whole; everything else is left to the search.
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "parse.h"
+#include "expression.h"
+#include "linearize.h"
+#include "flow.h"
+
+/* What a bb does with the variable */
+#define BB_ACCESS	1	/* loads or stores it */
+#define BB_STORE	2	/* stores it */
+#define BB_LIVE		4	/* needs it on entry */
+#define BB_QUEUED	8
+#define BB_PHI		16	/* gets a phi-node for it */
+
+static void *alloc_ssa(int nr, int size)
+{
+	void *ptr = calloc(nr, size);
+
+	if (!ptr)
+		die("out of memory");
+	return ptr;
+}
+
+static inline int is_access(struct instruction *insn, pseudo_t pseudo)
+{
+	int opcode = insn->opcode;
+
+	return (opcode == OP_LOAD || opcode == OP_STORE) && insn->src == pseudo;
+}
+
+/*
+ * Does the bb read the variable before storing to it?
+ */
+static int upward_exposed(struct basic_block *bb, pseudo_t pseudo)
+{
+	struct instruction *insn;
+
+	FOR_EACH_PTR(bb->insns, insn) {
+		if (insn->bb && is_access(insn, pseudo))
+			return insn->opcode == OP_LOAD;
+	} END_FOR_EACH_PTR(insn);
+	return 0;
+}
+
+/*
+ * The value of the variable at the end of each bb, going down the
+ * dominator tree: without a phi-node a bb starts off with whatever
+ * its immediate dominator ended with.
+ */
+static void rename_loads(struct entrypoint *ep, pseudo_t pseudo, unsigned char *flags,
+	struct instruction **phis, pseudo_t *value, int nr)
+{
+	struct basic_block **stack = alloc_ssa(nr, sizeof(*stack));
+	int top = 0;
+
+	stack[top++] = ep->entry->bb;
+	while (top) {
+		struct basic_block *bb = stack[--top], *child;
+		int n = bb->postorder_nr;
+		pseudo_t cur = bb->idom ? value[bb->idom->postorder_nr] : NULL;
+
+		if (flags[n] & BB_PHI)
+			cur = phis[n]->target;
+		if (flags[n] & BB_ACCESS) {
+			struct instruction *insn;
+
+			FOR_EACH_PTR(bb->insns, insn) {
+				if (!insn->bb || !is_access(insn, pseudo))
+					continue;
+				if (insn->opcode == OP_STORE) {
+					cur = insn->target;
+					continue;
+				}
+				/* Never stored to on the way here */
+				if (!cur) {
+					check_access(insn);
+					convert_load_instruction(insn, value_pseudo(0));
+					continue;
+				}
+				convert_load_instruction(insn, cur);
+			} END_FOR_EACH_PTR(insn);
+		}
+		value[n] = cur;
+
+		FOR_EACH_PTR(bb->doms, child) {
+			stack[top++] = child;
+		} END_FOR_EACH_PTR(child);
+	}
+	free(stack);
+}
+
+/*
+ * Give the phi-node of "bb" its sources: the value at the end of
+ * each reachable parent. A path along which the variable was never
+ * stored to brings in zero, like a load with no store before it;
+ * leaving it out would let a one-source phi-node be folded into a
+ * value that doesn't dominate its uses.
+ */
+static void add_phi_sources(struct instruction *phi_node, pseudo_t pseudo, pseudo_t *value)
+{
+	struct basic_block *bb = phi_node->bb, *parent;
+
+	FOR_EACH_PTR(bb->parents, parent) {
+		struct instruction *br;
+		pseudo_t src, phi;
+
+		if (!parent->dom_pre)
+			continue;
+		src = value[parent->postorder_nr];
+		if (!src)
+			src = value_pseudo(0);
+		br = delete_last_instruction(&parent->insns);
+		phi = alloc_phi(parent, src, phi_node->size);
+		phi->ident = phi->ident ? : pseudo->ident;
+		add_instruction(&parent->insns, br);
+		use_pseudo(phi_node, phi, add_pseudo(&phi_node->phi_list, phi));
+	} END_FOR_EACH_PTR(parent);
+}
+
+int ssa_convert_symbol(struct entrypoint *ep, pseudo_t pseudo)
+{
+	struct basic_block **work, *bb;
+	struct instruction **phis;
+	struct basic_block_list *phi_bbs = NULL;
+	struct pseudo_user *pu;
+	unsigned char *flags;
+	pseudo_t *value;
+	int nr, top = 0, size = -1;
+
+	build_dom_frontiers(ep);
+
+	/* Only whole accesses, from bbs the dominator tree knows about */
+	FOR_EACH_USER(pseudo, pu) {
+		struct instruction *insn = pu->insn;
+
+		if (!insn->bb || !is_access(insn, pseudo))
+			continue;
+		if (!insn->bb->dom_pre)
+			return 0;
+		if (size < 0)
+			size = insn->size;
+		if (insn->size != size)
+			return 0;
+	} END_FOR_EACH_USER(pu);
+
+	/* The entry is the last bb in postorder */
+	nr = ep->entry->bb->postorder_nr + 1;
+	flags = alloc_ssa(nr, sizeof(*flags));
+	phis = alloc_ssa(nr, sizeof(*phis));
+	value = alloc_ssa(nr, sizeof(*value));
+	work = alloc_ssa(nr, sizeof(*work));
+
+	FOR_EACH_USER(pseudo, pu) {
+		struct instruction *insn = pu->insn;
+
+		if (!insn->bb || !is_access(insn, pseudo))
+			continue;
+		bb = insn->bb;
+		if (!(flags[bb->postorder_nr] & BB_ACCESS)) {
+			flags[bb->postorder_nr] |= BB_ACCESS;
+			if (upward_exposed(bb, pseudo)) {
+				flags[bb->postorder_nr] |= BB_LIVE;
+				work[top++] = bb;
+			}
+		}
+		if (insn->opcode == OP_STORE)
+			flags[bb->postorder_nr] |= BB_STORE;
+	} END_FOR_EACH_USER(pu);
+
+	/* Where is the variable live on entry? */
+	while (top) {
+		struct basic_block *parent;
+
+		bb = work[--top];
+		FOR_EACH_PTR(bb->parents, parent) {
+			int n = parent->postorder_nr;
+			if (!parent->dom_pre || (flags[n] & (BB_LIVE | BB_STORE)))
+				continue;
+			flags[n] |= BB_LIVE;
+			work[top++] = parent;
+		} END_FOR_EACH_PTR(parent);
+	}
+
+	/* Phi-nodes on the iterated dominance frontier of the stores */
+	FOR_EACH_PTR(ep->bbs, bb) {
+		int n = bb->postorder_nr;
+		if (bb->dom_pre && (flags[n] & BB_STORE)) {
+			flags[n] |= BB_QUEUED;
+			work[top++] = bb;
+		}
+	} END_FOR_EACH_PTR(bb);
+	while (top) {
+		struct basic_block *df;
+
+		bb = work[--top];
+		FOR_EACH_PTR(bb->df, df) {
+			int n = df->postorder_nr;
+			if (!(flags[n] & BB_LIVE) || (flags[n] & BB_PHI))
+				continue;
+			flags[n] |= BB_PHI;
+			phis[n] = insert_phi_node(df, size);
+			phis[n]->target->ident = pseudo->ident;
+			add_bb(&phi_bbs, df);
+			if (flags[n] & BB_QUEUED)
+				continue;
+			flags[n] |= BB_QUEUED;
+			work[top++] = df;
+		} END_FOR_EACH_PTR(df);
+	}
+
+	rename_loads(ep, pseudo, flags, phis, value, nr);
+	FOR_EACH_PTR(phi_bbs, bb) {
+		add_phi_sources(phis[bb->postorder_nr], pseudo, value);
+	} END_FOR_EACH_PTR(bb);
+	free_ptr_list(&phi_bbs);
+
+	/* All the loads are gone, and so are the stores */
+	FOR_EACH_USER(pseudo, pu) {
+		struct instruction *insn = pu->insn;
+		if (insn->opcode == OP_STORE)
+			kill_store(insn);
+		else if (insn->opcode == OP_LOAD)
+			insn->opcode = OP_LNOP;
+	} END_FOR_EACH_USER(pu);
+
+	free(work);
+	free(value);
+	free(phis);
+	free(flags);
+	return 1;
+}
@@ -532,6 +532,23 @@ void create_fouled(struct symbol *type)
 	}
 }
 
+static int fouled_mark;
+
+void mark_fouled_types(void)
+{
+	fouled_mark = symbol_list_size(fouled);
+}
+
+void rollback_fouled_types(void)
+{
+	int nr = symbol_list_size(fouled);
+
+	while (nr-- > fouled_mark) {
+		delete_ptr_list_last((struct ptr_list **)&restr);
+		delete_ptr_list_last((struct ptr_list **)&fouled);
+	}
+}
+
 struct symbol *befoul(struct symbol *type)
 {
 	struct symbol *t1, *t2;
@@ -216,6 +216,7 @@ struct symbol {
 #define MOD_LONGLONG	0x0800
 #define MOD_LONGLONGLONG	0x1000
 #define MOD_PURE	0x2000
+#define MOD_RESTRICT	0x4000
 
 #define MOD_TYPEDEF	0x10000
 
@@ -245,7 +246,8 @@ struct symbol {
 #define MOD_SPECIFIER	(MOD_CHAR | MOD_SHORT | MOD_LONG_ALL | MOD_SIGNEDNESS)
 #define MOD_SIZE	(MOD_CHAR | MOD_SHORT | MOD_LONG_ALL)
 #define MOD_IGNORE (MOD_TOPLEVEL | MOD_STORAGE | MOD_ADDRESSABLE |	\
-	MOD_ASSIGNED | MOD_USERTYPE | MOD_ACCESSED | MOD_EXPLICITLY_SIGNED)
+	MOD_ASSIGNED | MOD_USERTYPE | MOD_ACCESSED | MOD_EXPLICITLY_SIGNED | \
+	MOD_RESTRICT)
 #define MOD_PTRINHERIT (MOD_VOLATILE | MOD_CONST | MOD_NODEREF | MOD_STORAGE | MOD_NORETURN)
 
 
@@ -406,5 +408,7 @@ extern int is_ptr_type(struct symbol *);
 
 void create_fouled(struct symbol *type);
 struct symbol *befoul(struct symbol *type);
+void mark_fouled_types(void);
+void rollback_fouled_types(void);
 
 #endif /* SYMBOL_H */
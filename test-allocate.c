@@ -0,0 +1,108 @@
+/*
+ * Test program for handing allocations over between threads: a
+ * worker thread allocates objects and hands them off, the main
+ * thread merges them into its own allocator and checks they are
+ * still there, that it goes on allocating after them, and that
+ * rolling back drops them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "lib.h"
+#include "allocate.h"
+
+struct item {
+	int owner, nr;
+};
+
+DECLARE_ALLOCATOR(item);
+ALLOCATOR(item, "items");
+
+#define NR_WORKER_ITEMS	10000
+#define NR_MAIN_ITEMS	100
+
+static struct item *worker_items[NR_WORKER_ITEMS];
+static struct item *main_items[NR_MAIN_ITEMS];
+
+static int nr_blobs(void)
+{
+	struct allocation_blob *blob;
+	int nr = 0;
+
+	for (blob = item_allocator.blobs; blob; blob = blob->next)
+		nr++;
+	return nr;
+}
+
+static void show_items(const char *name)
+{
+	printf("%s: %llu items in %d blobs\n", name,
+		item_allocator.allocations, nr_blobs());
+}
+
+static void check_items(struct item **items, int nr, int owner)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (items[i]->owner != owner || items[i]->nr != i)
+			printf("  item %d of %d is %d of %d\n", i, owner,
+				items[i]->nr, items[i]->owner);
+	}
+}
+
+static void *worker(void *arg)
+{
+	struct allocator_handoff *handoff;
+	int i;
+
+	for (i = 0; i < NR_WORKER_ITEMS; i++) {
+		struct item *item = __alloc_item(0);
+
+		item->owner = 1;
+		item->nr = i;
+		worker_items[i] = item;
+	}
+	show_items("worker");
+	handoff = handoff_allocations();
+	show_items("worker after handoff");
+	return handoff;
+}
+
+int main(int argc, char **argv)
+{
+	struct allocator_mark mark;
+	struct item *item;
+	pthread_t thread;
+	void *handoff;
+	int i;
+
+	for (i = 0; i < NR_MAIN_ITEMS; i++) {
+		item = __alloc_item(0);
+		item->owner = 0;
+		item->nr = i;
+		main_items[i] = item;
+	}
+	show_items("main");
+	mark_item_alloc(&mark);
+
+	if (pthread_create(&thread, NULL, worker, NULL) ||
+	    pthread_join(thread, &handoff))
+		die("can't run the worker thread");
+	merge_allocations(handoff);
+	show_items("merged");
+	check_items(worker_items, NR_WORKER_ITEMS, 1);
+	check_items(main_items, NR_MAIN_ITEMS, 0);
+
+	/* New allocations go after the worker's last one */
+	item = __alloc_item(0);
+	if (item != worker_items[NR_WORKER_ITEMS - 1] + 1)
+		printf("  new item not in the worker's last blob\n");
+
+	/* The merged blobs came after the mark */
+	rollback_item_alloc(&mark);
+	show_items("rolled back");
+	check_items(main_items, NR_MAIN_ITEMS, 0);
+	return 0;
+}
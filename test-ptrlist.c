@@ -0,0 +1,142 @@
+/*
+ * Test program for the pointer lists, plain and vector ones and
+ * lists mixing both kinds of nodes: it prints the nodes of each
+ * list it builds, and checks that walking it gives the entries
+ * back in order.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lib.h"
+#include "ptrlist.h"
+
+DECLARE_PTR_LIST(value_list, int);
+
+#define NR_VALUES 1000
+
+static int values[NR_VALUES];
+
+static void show_nodes(const char *name, struct value_list *list)
+{
+	struct ptr_list *head = (struct ptr_list *) list, *node = head;
+	int *val, expected = 0;
+
+	printf("%s:", name);
+	if (node) {
+		do {
+			printf(" %d/%d", node->nr, ptr_list_node_nr(node));
+			node = node->next;
+		} while (node != head);
+	}
+	printf("\n");
+
+	FOR_EACH_PTR(list, val) {
+		if (*val != expected)
+			printf("  entry %d is %d\n", expected, *val);
+		expected++;
+	} END_FOR_EACH_PTR(val);
+	if (expected != ptr_list_size(head))
+		printf("  %d entries walked, but the list has %d\n",
+			expected, ptr_list_size(head));
+}
+
+static void add_plain(struct value_list **list, int from, int to)
+{
+	for (; from < to; from++) {
+		int *val = values + from;
+		add_ptr_list(list, val);
+	}
+}
+
+static void add_vector(struct value_list **list, int from, int to)
+{
+	for (; from < to; from++) {
+		int *val = values + from;
+		add_ptr_vec(list, val);
+	}
+}
+
+static int cmp_values(const void *a, const void *b)
+{
+	int x = *(const int *) a, y = *(const int *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	struct value_list *list = NULL;
+	int i, prev, *val;
+
+	for (i = 0; i < NR_VALUES; i++)
+		values[i] = i;
+
+	add_vector(&list, 0, 100);
+	show_nodes("vector", list);
+	free_ptr_list(&list);
+
+	/* Past a full plain node, the vector starts small again */
+	add_plain(&list, 0, LIST_NODE_NR);
+	add_vector(&list, LIST_NODE_NR, 60);
+	show_nodes("plain then vector", list);
+	free_ptr_list(&list);
+
+	/* A plain add to a vector goes on growing it */
+	add_vector(&list, 0, 10);
+	add_plain(&list, 10, 60);
+	show_nodes("vector then plain", list);
+	free_ptr_list(&list);
+
+	/* Room in the last plain node is used first */
+	add_plain(&list, 0, 10);
+	add_vector(&list, 10, 40);
+	show_nodes("part plain then vector", list);
+	free_ptr_list(&list);
+
+	/* Inserting into full nodes splits them, keeping their kind */
+	for (i = 0; i < LIST_NODE_NR + 13; i++) {
+		val = values + 2 * i;
+		if (i < LIST_NODE_NR)
+			add_ptr_list(&list, val);
+		else
+			add_ptr_vec(&list, val);
+	}
+	prev = -1;
+	FOR_EACH_PTR(list, val) {
+		/* The walk comes back to the entry after an insert */
+		if (*val == prev + 1) {
+			prev = *val;
+			continue;
+		}
+		INSERT_CURRENT(values + *val - 1, val);
+		prev = *val - 1;
+	} END_FOR_EACH_PTR(val);
+	show_nodes("odd ones inserted", list);
+
+	/* Deleting empties nodes, packing drops them */
+	FOR_EACH_PTR(list, val) {
+		if (*val >= 20 && *val < 70)
+			DELETE_CURRENT_PTR(val);
+	} END_FOR_EACH_PTR(val);
+	PACK_PTR_LIST(&list);
+	FOR_EACH_PTR(list, val) {
+		if (*val >= 70)
+			DELETE_CURRENT_PTR(val);
+	} END_FOR_EACH_PTR(val);
+	PACK_PTR_LIST(&list);
+	show_nodes("deleted from 20", list);
+	free_ptr_list(&list);
+
+	/* Sorting goes through the nodes of both kinds */
+	for (i = 0; i < 50; i++) {
+		val = values + (i * 17) % 50;
+		if (i & 1)
+			add_ptr_vec(&list, val);
+		else
+			add_ptr_list(&list, val);
+	}
+	sort_list((struct ptr_list **) &list, cmp_values);
+	show_nodes("sorted", list);
+	free_ptr_list(&list);
+	return 0;
+}
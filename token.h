@@ -57,6 +57,10 @@ struct stream {
 	/* Use these to check for "already parsed" */
 	enum constantfile constant;
 	int dirty, next_stream, once;
+	unsigned int hash;	/* of the name */
+	int next_file;		/* -2 if not a regular file */
+	dev_t dev;
+	ino_t ino;
 	struct ident *protect;
 	struct token *ifndef;
 	struct token *top_if;
@@ -65,11 +69,13 @@ struct stream {
 extern int input_stream_nr;
 extern struct stream *input_streams;
 extern unsigned int tabstop;
-extern int *hash_stream(const char *name);
+extern int find_stream(const char *name, int (*still_valid)(struct stream *));
+extern int find_stream_file(int fd, int (*still_valid)(struct stream *));
 
 struct ident {
 	struct ident *next;	/* Hash chain of identifiers */
 	struct symbol *symbols;	/* Pointer to semantic meaning list */
+	unsigned int hash;	/* Full hash of the name */
 	unsigned char len;	/* Length of identifier name */
 	unsigned char tainted:1,
 	              reserved:1,
@@ -83,6 +89,7 @@ enum token_type {
 	TOKEN_IDENT,
 	TOKEN_ZERO_IDENT,
 	TOKEN_NUMBER,
+	TOKEN_NUMBER_EMBEDDED,
 	TOKEN_CHAR,
 	TOKEN_CHAR_EMBEDDED_0,
 	TOKEN_CHAR_EMBEDDED_1,
@@ -192,6 +199,7 @@ struct token {
 		int argnum;
 		struct argcount count;
 		char embedded[4];
+		char short_number[sizeof(const char *)];
 	};
 };
 
@@ -205,6 +213,22 @@ static inline struct token *containing_token(struct token **p)
 
 #define token_type(x) ((x)->pos.type)
 
+/*
+ * pp-numbers short enough to fit, NUL included, in place of the
+ * pointer are kept in the token itself (TOKEN_NUMBER_EMBEDDED).
+ */
+static inline const char *token_number(const struct token *token)
+{
+	if (token_type(token) == TOKEN_NUMBER_EMBEDDED)
+		return token->short_number;
+	return token->number;
+}
+
+static inline int token_is_number(int type)
+{
+	return type == TOKEN_NUMBER || type == TOKEN_NUMBER_EMBEDDED;
+}
+
 /*
  * Last token in the stream - points to itself.
  * This allows us to not test for NULL pointers
@@ -214,6 +238,8 @@ extern struct token eof_token_entry;
 #define eof_token(x) ((x) == &eof_token_entry)
 
 extern int init_stream(const char *, int fd, const char **next_path);
+extern void mark_streams(void);
+extern void rollback_streams(void);
 extern const char *stream_name(int stream);
 extern struct ident *hash_ident(struct ident *);
 extern struct ident *built_in_ident(const char *);
@@ -223,6 +249,7 @@ extern const char *show_ident(const struct ident *);
 extern const char *show_string(const struct string *string);
 extern const char *show_token(const struct token *);
 extern const char *quote_token(const struct token *);
+extern void set_token_number(struct token *, const char *, int size);
 extern struct token * tokenize(const char *, int, struct token *, const char **next_path);
 extern struct token * tokenize_buffer(void *, unsigned long, struct token **);
 
@@ -31,6 +31,8 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <limits.h>
+#include <sys/stat.h>
 
 #include "lib.h"
 #include "allocate.h"
@@ -46,6 +48,11 @@ unsigned int tabstop = 8;
 
 #define BUFSIZE (8192)
 
+/*
+ * The buffer always has a NUL after its "size" bytes, so that
+ * nextchar() can look at the next byte without checking where
+ * the buffer ends.
+ */
 typedef struct {
 	int fd, offset, size;
 	int pos, line, nr;
@@ -190,7 +197,8 @@ const char *show_token(const struct token *token)
 		return show_ident(token->ident);
 
 	case TOKEN_NUMBER:
-		return token->number;
+	case TOKEN_NUMBER_EMBEDDED:
+		return token_number(token);
 
 	case TOKEN_SPECIAL:
 		return show_special(token->special);
@@ -248,7 +256,8 @@ const char *quote_token(const struct token *token)
 		return show_ident(token->ident);
 
 	case TOKEN_NUMBER:
-		return token->number;
+	case TOKEN_NUMBER_EMBEDDED:
+		return token_number(token);
 
 	case TOKEN_SPECIAL:
 		return show_special(token->special);
@@ -277,13 +286,20 @@ const char *quote_token(const struct token *token)
 	}
 }
 
+/*
+ * The streams are indexed twice: by name, so that a path that was
+ * already seen is answered without a system call, and by device and
+ * inode, so that a file reached under another name is found too.
+ * Both tables start small and double with the number of streams;
+ * the chains link the newest stream first.
+ */
 #define HASHED_INPUT_BITS (6)
-#define HASHED_INPUT (1 << HASHED_INPUT_BITS)
 #define HASH_PRIME 0x9e370001UL
 
-static int input_stream_hashes[HASHED_INPUT] = { [0 ... HASHED_INPUT-1] = -1 };
+static int *stream_names, *stream_files;
+static int stream_hash_bits;
 
-int *hash_stream(const char *name)
+static unsigned int hash_stream_name(const char *name)
 {
 	uint32_t hash = 0;
 	unsigned char c;
@@ -291,15 +307,103 @@ int *hash_stream(const char *name)
 	while ((c = *name++) != 0)
 		hash = (hash + (c << 4) + (c >> 4)) * 11;
 
-	hash *= HASH_PRIME;
-	hash >>= 32 - HASHED_INPUT_BITS;
-	return input_stream_hashes + hash;
+	return hash * HASH_PRIME;
+}
+
+static unsigned int hash_stream_file(dev_t dev, ino_t ino)
+{
+	uint32_t hash = ((uint64_t)ino * 11 + dev) ^ ((uint64_t)ino >> 32);
+
+	return hash * HASH_PRIME;
+}
+
+static inline int *stream_bucket(int *table, unsigned int hash)
+{
+	return table + (hash >> (32 - stream_hash_bits));
+}
+
+static void link_stream(int stream)
+{
+	struct stream *s = input_streams + stream;
+	int *head = stream_bucket(stream_names, s->hash);
+
+	s->next_stream = *head;
+	*head = stream;
+	if (s->next_file == -2)
+		return;
+	head = stream_bucket(stream_files, hash_stream_file(s->dev, s->ino));
+	s->next_file = *head;
+	*head = stream;
+}
+
+static void grow_stream_hashes(void)
+{
+	int bits = stream_hash_bits ? stream_hash_bits + 1 : HASHED_INPUT_BITS;
+	int i, size = 1 << bits;
+
+	free(stream_names);
+	stream_names = malloc(2 * size * sizeof(int));
+	if (!stream_names)
+		die("Unable to allocate more streams space");
+	stream_files = stream_names + size;
+	for (i = 0; i < 2 * size; i++)
+		stream_names[i] = -1;
+	stream_hash_bits = bits;
+	for (i = 0; i < input_stream_nr; i++)
+		link_stream(i);
+}
+
+/*
+ * The newest stream called "name" that is "still_valid", or -1.
+ */
+int find_stream(const char *name, int (*still_valid)(struct stream *))
+{
+	unsigned int hash = hash_stream_name(name);
+	int stream;
+
+	if (!stream_hash_bits)
+		return -1;
+	stream = *stream_bucket(stream_names, hash);
+	for (; stream >= 0; stream = input_streams[stream].next_stream) {
+		struct stream *s = input_streams + stream;
+
+		if (s->hash != hash || strcmp(name, s->name))
+			continue;
+		if (still_valid(s))
+			return stream;
+	}
+	return -1;
+}
+
+/*
+ * Same, for the regular file open on "fd", whatever its name.
+ */
+int find_stream_file(int fd, int (*still_valid)(struct stream *))
+{
+	struct stat st;
+	int stream;
+
+	if (!stream_hash_bits || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return -1;
+	if (!st.st_ino)
+		return -1;
+	stream = *stream_bucket(stream_files, hash_stream_file(st.st_dev, st.st_ino));
+	for (; stream >= 0; stream = input_streams[stream].next_file) {
+		struct stream *s = input_streams + stream;
+
+		if (s->ino != st.st_ino || s->dev != st.st_dev)
+			continue;
+		if (still_valid(s))
+			return stream;
+	}
+	return -1;
 }
 
 int init_stream(const char *name, int fd, const char **next_path)
 {
-	int stream = input_stream_nr, *hash;
+	int stream = input_stream_nr;
 	struct stream *current;
+	struct stat st;
 
 	if (stream >= input_streams_allocated) {
 		int newalloc = stream * 4 / 3 + 10;
@@ -315,13 +419,52 @@ int init_stream(const char *name, int fd, const char **next_path)
 	current->next_path = next_path;
 	current->path = NULL;
 	current->constant = CONSTANT_FILE_MAYBE;
+	current->hash = hash_stream_name(name);
+	current->next_file = -2;
+	if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_ino) {
+		current->dev = st.st_dev;
+		current->ino = st.st_ino;
+		current->next_file = -1;
+	}
 	input_stream_nr = stream+1;
-	hash = hash_stream(name);
-	current->next_stream = *hash;
-	*hash = stream;
+	if (!stream_hash_bits || input_stream_nr > 1 << stream_hash_bits)
+		grow_stream_hashes();
+	else
+		link_stream(stream);
 	return stream;
 }
 
+static int input_stream_mark;
+
+void mark_streams(void)
+{
+	input_stream_mark = input_stream_nr;
+}
+
+/*
+ * Forget the streams opened since mark_streams(): their names
+ * live in the allocators and go away with them.
+ */
+void rollback_streams(void)
+{
+	int i;
+
+	for (i = 0; stream_names && i < 1 << stream_hash_bits; i++) {
+		int *head = stream_names + i;
+		while (*head >= input_stream_mark)
+			*head = input_streams[*head].next_stream;
+		head = stream_files + i;
+		while (*head >= input_stream_mark)
+			*head = input_streams[*head].next_file;
+	}
+	for (i = input_stream_mark; i < input_stream_nr; i++) {
+		const char *path = input_streams[i].path;
+		if (path && *path)
+			free((void *)path);
+	}
+	input_stream_nr = input_stream_mark;
+}
+
 static struct token * alloc_token(stream_t *stream)
 {
 	struct token *token = __alloc_token(0);
@@ -350,6 +493,7 @@ repeat:
 		size = read(stream->fd, stream->buffer, BUFSIZE);
 		if (size <= 0)
 			goto got_eof;
+		stream->buffer[size] = 0;
 		stream->size = size;
 		stream->offset = offset = 0;
 	}
@@ -417,22 +561,21 @@ got_eof:
 /*
  *  We want that as light as possible while covering all normal cases.
  *  Slow path (including the logics with line-splicing and EOF sanity
- *  checks) is in nextchar_slow().
+ *  checks) is in nextchar_slow(). The end of the buffer is a NUL,
+ *  so that it goes there too without a check of its own.
  */
 static inline int nextchar(stream_t *stream)
 {
 	int offset = stream->offset;
+	int c = stream->buffer[offset];
+	static const char special[256] = {
+		['\0'] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['\\'] = 1
+	};
 
-	if (offset < stream->size) {
-		int c = stream->buffer[offset++];
-		static const char special[256] = {
-			['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['\\'] = 1
-		};
-		if (!special[c]) {
-			stream->offset = offset;
-			stream->pos++;
-			return c;
-		}
+	if (!special[c]) {
+		stream->offset = offset + 1;
+		stream->pos++;
+		return c;
 	}
 	return nextchar_slow(stream);
 }
@@ -526,6 +669,128 @@ static const long cclass[257] = {
 	['?' + 1] = Escape,
 };
 
+/*
+ * Bulk scanners: they return how many of the bytes at the current
+ * offset nextchar() would simply count, one by one, so that the
+ * callers can skip them in a single step. Anything in the "stop"
+ * set (line ends, tabs, backslashes, the terminating NUL) is left
+ * to nextchar() and its slow path. With SSE2 the long runs are
+ * looked at 16 bytes at a time, the tails go through the tables;
+ * none of them reads past the NUL after the end of the buffer.
+ */
+static const char comment_stop[256] = {
+	['\0'] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['\\'] = 1, ['*'] = 1
+};
+
+static const char eoln_stop[256] = {
+	['\0'] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['\\'] = 1
+};
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+static inline __m128i match_byte(__m128i v, char c)
+{
+	return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+/* bytes in [lo, lo + n), with the signed compare of SSE2 */
+static inline __m128i match_range(__m128i v, char lo, int n)
+{
+	__m128i x = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+	x = _mm_xor_si128(x, _mm_set1_epi8(-128));
+	return _mm_cmplt_epi8(x, _mm_set1_epi8(-128 + n));
+}
+
+static int vector_stop_run(const unsigned char *p, int n, int star)
+{
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		__m128i m = _mm_or_si128(match_byte(v, '\0'), match_byte(v, '\\'));
+		int mask;
+
+		m = _mm_or_si128(m, match_byte(v, '\n'));
+		m = _mm_or_si128(m, match_byte(v, '\r'));
+		m = _mm_or_si128(m, match_byte(v, '\t'));
+		if (star)
+			m = _mm_or_si128(m, match_byte(v, '*'));
+		mask = _mm_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i;
+}
+
+static int vector_ident_run(const unsigned char *p, int n)
+{
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		__m128i m = match_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26);
+		int mask;
+
+		m = _mm_or_si128(m, match_range(v, '0', 10));
+		m = _mm_or_si128(m, match_byte(v, '_'));
+		mask = ~_mm_movemask_epi8(m) & 0xffff;
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i;
+}
+#else
+#define vector_stop_run(p, n, star)	0
+#define vector_ident_run(p, n)		0
+#endif
+
+static int stop_run(stream_t *stream, const char *stop)
+{
+	const unsigned char *p = stream->buffer + stream->offset;
+	int i = vector_stop_run(p, stream->size - stream->offset, stop['*']);
+
+	while (!stop[p[i]])
+		i++;
+	return i;
+}
+
+static int ident_run(stream_t *stream, int max)
+{
+	const unsigned char *p = stream->buffer + stream->offset;
+	int n = stream->size - stream->offset;
+	int i;
+
+	if (n > max)
+		n = max;
+	i = vector_ident_run(p, n);
+	while (i < n && (cclass[p[i] + 1] & (Letter | Digit)))
+		i++;
+	return i;
+}
+
+static inline void skip_run(stream_t *stream, int n)
+{
+	stream->offset += n;
+	stream->pos += n;
+}
+
+/* "size" counts the NUL at the end of "str" */
+void set_token_number(struct token *token, const char *str, int size)
+{
+	char *buf;
+
+	if (size <= sizeof(token->short_number)) {
+		token_type(token) = TOKEN_NUMBER_EMBEDDED;
+		memcpy(token->short_number, str, size);
+		return;
+	}
+	buf = __alloc_bytes(size);
+	memcpy(buf, str, size);
+	token_type(token) = TOKEN_NUMBER;
+	token->number = buf;
+}
+
 /*
  * pp-number:
  *	digit
@@ -542,7 +807,7 @@ static int get_one_number(int c, int next, stream_t *stream)
 {
 	struct token *token;
 	static char buffer[4095];
-	char *p = buffer, *buf, *buffer_end = buffer + sizeof (buffer);
+	char *p = buffer, *buffer_end = buffer + sizeof (buffer);
 	int len;
 
 	*p++ = c;
@@ -572,12 +837,9 @@ static int get_one_number(int c, int next, stream_t *stream)
 
 	*p++ = 0;
 	len = p - buffer;
-	buf = __alloc_bytes(len);
-	memcpy(buf, buffer, len);
 
 	token = stream->token;
-	token_type(token) = TOKEN_NUMBER;
-	token->number = buf;
+	set_token_number(token, buffer, len);
 	add_token(stream);
 
 	return next;
@@ -657,6 +919,7 @@ static int drop_stream_eoln(stream_t *stream)
 {
 	drop_token(stream);
 	for (;;) {
+		skip_run(stream, stop_run(stream, eoln_stop));
 		switch (nextchar(stream)) {
 		case EOF:
 			return EOF;
@@ -680,6 +943,8 @@ static int drop_stream_comment(stream_t *stream)
 			warning(stream_pos(stream), "End of file in the middle of a comment");
 			return curr;
 		}
+		if (curr != '*')
+			skip_run(stream, stop_run(stream, comment_stop));
 		next = nextchar(stream);
 		if (curr == '*' && next == '/')
 			break;
@@ -801,16 +1066,57 @@ static int get_one_special(int c, stream_t *stream)
 	return next;
 }
 
+/*
+ * Identifiers are hashed with FNV-1a as they are scanned; the result
+ * is mixed once more at the end so that the low bits, which pick the
+ * bucket, depend on every byte. The full hash is kept in the ident,
+ * so lookups only compare names when it matches and growing the
+ * table doesn't need the names at all.
+ */
 #define IDENT_HASH_BITS (13)
-#define IDENT_HASH_SIZE (1<<IDENT_HASH_BITS)
-#define IDENT_HASH_MASK (IDENT_HASH_SIZE-1)
+#define IDENT_HASH_PRIME 16777619U
+
+#define ident_hash_init(c)		((2166136261U ^ (c)) * IDENT_HASH_PRIME)
+#define ident_hash_add(oldhash,c)	(((oldhash) ^ (c)) * IDENT_HASH_PRIME)
 
-#define ident_hash_init(c)		(c)
-#define ident_hash_add(oldhash,c)	((oldhash)*11 + (c))
-#define ident_hash_end(hash)		((((hash) >> IDENT_HASH_BITS) + (hash)) & IDENT_HASH_MASK)
+static inline unsigned int ident_hash_end(unsigned int hash)
+{
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+/* The table doubles when there are more identifiers than buckets */
+static struct ident **hash_table;
+static unsigned int hash_size, hash_mask;
+static int ident_hit, ident_miss, idents, ident_compares;
+
+static void grow_hash_table(void)
+{
+	unsigned int size = hash_size ? hash_size * 2 : 1 << IDENT_HASH_BITS;
+	struct ident **table = calloc(size, sizeof(*table));
+	unsigned int i;
 
-static struct ident *hash_table[IDENT_HASH_SIZE];
-static int ident_hit, ident_miss, idents;
+	if (!table)
+		die("Unable to allocate more identifier hash space");
+	for (i = 0; i < hash_size; i++) {
+		struct ident *ident = hash_table[i];
+
+		while (ident) {
+			struct ident *next = ident->next;
+			struct ident **p = &table[ident->hash & (size - 1)];
+
+			ident->next = *p;
+			*p = ident;
+			ident = next;
+		}
+	}
+	free(hash_table);
+	hash_table = table;
+	hash_size = size;
+	hash_mask = size - 1;
+}
 
 void show_identifier_stats(void)
 {
@@ -819,11 +1125,14 @@ void show_identifier_stats(void)
 
 	fprintf(stderr, "identifiers: %d hits, %d misses\n",
 		ident_hit, ident_miss);
+	fprintf(stderr, "%d identifiers in %u buckets, %.2f compares per lookup\n",
+		idents, hash_size,
+		(double) ident_compares / ((ident_hit + ident_miss) ? : 1));
 
 	for (i = 0; i < 100; i++)
 		distribution[i] = 0;
 
-	for (i = 0; i < IDENT_HASH_SIZE; i++) {
+	for (i = 0; i < hash_size; i++) {
 		struct ident * ident = hash_table[i];
 		int count = 0;
 
@@ -852,43 +1161,43 @@ static struct ident *alloc_ident(const char *name, int len)
 	return ident;
 }
 
-static struct ident * insert_hash(struct ident *ident, unsigned long hash)
+static struct ident *insert_hash(struct ident *ident, unsigned int hash)
 {
-	ident->next = hash_table[hash];
-	hash_table[hash] = ident;
+	struct ident **p;
+
+	if (idents >= hash_size)
+		grow_hash_table();
+	p = &hash_table[hash & hash_mask];
+	ident->hash = hash;
+	ident->next = *p;
+	*p = ident;
 	ident_miss++;
+	idents++;
 	return ident;
 }
 
-static struct ident *create_hashed_ident(const char *name, int len, unsigned long hash)
+static struct ident *create_hashed_ident(const char *name, int len, unsigned int hash)
 {
 	struct ident *ident;
-	struct ident **p;
-
-	p = &hash_table[hash];
-	while ((ident = *p) != NULL) {
-		if (ident->len == (unsigned char) len) {
-			if (strncmp(name, ident->name, len) != 0)
-				goto next;
 
+	if (hash_table) {
+		ident = hash_table[hash & hash_mask];
+		for (; ident; ident = ident->next) {
+			ident_compares++;
+			if (ident->hash != hash || ident->len != (unsigned char) len)
+				continue;
+			if (memcmp(name, ident->name, len) != 0)
+				continue;
 			ident_hit++;
 			return ident;
 		}
-next:
-		//misses++;
-		p = &ident->next;
 	}
-	ident = alloc_ident(name, len);
-	*p = ident;
-	ident->next = NULL;
-	ident_miss++;
-	idents++;
-	return ident;
+	return insert_hash(alloc_ident(name, len), hash);
 }
 
-static unsigned long hash_name(const char *name, int len)
+static unsigned int hash_name(const char *name, int len)
 {
-	unsigned long hash;
+	unsigned int hash;
 	const unsigned char *p = (const unsigned char *)name;
 
 	hash = ident_hash_init(*p++);
@@ -925,13 +1234,20 @@ static int get_one_identifier(int c, stream_t *stream)
 {
 	struct token *token;
 	struct ident *ident;
-	unsigned long hash;
+	unsigned int hash;
 	char buf[256];
-	int len = 1;
+	int len = 1, i = 1;
 	int next;
 
 	hash = ident_hash_init(c);
 	buf[0] = c;
+	len += ident_run(stream, sizeof(buf) - 1);
+	while (i < len) {
+		next = stream->buffer[stream->offset++];
+		hash = ident_hash_add(hash, next);
+		buf[i++] = next;
+	}
+	stream->pos += len - 1;
 	for (;;) {
 		next = nextchar(stream);
 		if (!(cclass[next + 1] & (Letter | Digit)))
@@ -996,8 +1312,38 @@ static struct token *setup_stream(stream_t *stream, int idx, int fd,
 	return begin;
 }
 
+/*
+ * Spaces, tabs and plain newlines between tokens, without going
+ * through nextchar() for each of them.
+ */
+static void skip_blanks(stream_t *stream)
+{
+	const unsigned char *p = stream->buffer;
+	int offset = stream->offset;
+
+	for (;; offset++) {
+		switch (p[offset]) {
+		case ' ':
+			stream->pos++;
+			continue;
+		case '\t':
+			stream->pos += tabstop - stream->pos % tabstop;
+			continue;
+		case '\n':
+			stream->line++;
+			stream->pos = 0;
+			stream->newline = 1;
+			continue;
+		}
+		stream->offset = offset;
+		return;
+	}
+}
+
 static struct token *tokenize_stream(stream_t *stream)
 {
+	enum alloc_phase phase = set_alloc_phase(ALLOC_PHASE_TOKENIZE);
+	struct token *end;
 	int c = nextchar(stream);
 	while (c != EOF) {
 		if (!isspace(c)) {
@@ -1009,11 +1355,15 @@ static struct token *tokenize_stream(stream_t *stream)
 			continue;
 		}
 		stream->whitespace = 1;
+		skip_blanks(stream);
 		c = nextchar(stream);
 	}
-	return mark_eof(stream);
+	end = mark_eof(stream);
+	set_alloc_phase(phase);
+	return end;
 }
 
+/* The buffer has to be followed by a NUL */
 struct token * tokenize_buffer(void *buffer, unsigned long size, struct token **endtoken)
 {
 	stream_t stream;
@@ -1024,11 +1374,29 @@ struct token * tokenize_buffer(void *buffer, unsigned long size, struct token **
 	return begin;
 }
 
+/*
+ * Regular files are mapped whole rather than read() a buffer at a
+ * time. The tokens don't point into the file, so it can go as soon
+ * as it has been tokenized.
+ */
+static unsigned char *map_stream(int fd, unsigned long *size)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return NULL;
+	if (!st.st_size || st.st_size >= INT_MAX)
+		return NULL;
+	*size = st.st_size;
+	return map_file(fd, *size);
+}
+
 struct token * tokenize(const char *name, int fd, struct token *endtoken, const char **next_path)
 {
 	struct token *begin, *end;
 	stream_t stream;
-	unsigned char buffer[BUFSIZE];
+	unsigned char buffer[BUFSIZE + 1], *map;
+	unsigned long size;
 	int idx;
 
 	idx = init_stream(name, fd, next_path);
@@ -1037,8 +1405,16 @@ struct token * tokenize(const char *name, int fd, struct token *endtoken, const
 		return endtoken;
 	}
 
-	begin = setup_stream(&stream, idx, fd, buffer, 0);
-	end = tokenize_stream(&stream);
+	map = map_stream(fd, &size);
+	if (map) {
+		begin = setup_stream(&stream, idx, -1, map, size);
+		end = tokenize_stream(&stream);
+		unmap_file(map, size);
+	} else {
+		buffer[0] = 0;
+		begin = setup_stream(&stream, idx, fd, buffer, 0);
+		end = tokenize_stream(&stream);
+	}
 	if (endtoken)
 		end->next = endtoken;
 	return begin;
@@ -0,0 +1,14 @@
+/*
+ * test-allocate runs its threads itself, this file is only its test case.
+ *
+ * check-name: allocations handed over between threads
+ * check-command: test-allocate
+ *
+ * check-output-start
+main: 100 items in 1 blobs
+worker: 10000 items in 3 blobs
+worker after handoff: 0 items in 0 blobs
+merged: 10100 items in 4 blobs
+rolled back: 100 items in 1 blobs
+ * check-output-end
+ */
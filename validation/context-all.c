@@ -0,0 +1,40 @@
+static void a(void) __attribute__((context(x,0,1)));
+static void r(void) __attribute__((context(x,1,0)));
+
+extern int c1, c2, c3;
+
+static void many(void)
+{
+	if (c1)
+		r();
+	a();
+	if (c2) {
+		a();
+		a();
+	}
+	r();
+	if (c3)
+		r();
+}
+
+#define STEP	if (c1) { a(); r(); }
+#define STEP10	STEP STEP STEP STEP STEP STEP STEP STEP STEP STEP
+#define STEP100	STEP10 STEP10 STEP10 STEP10 STEP10 STEP10 STEP10 STEP10 STEP10 STEP10
+
+static void deep(void)
+{
+	STEP100 STEP100 STEP100 STEP100 STEP100
+	STEP100 STEP100 STEP100 STEP100 STEP100
+	a();
+}
+
+/*
+ * check-name: all the context imbalances reported
+ *
+ * check-error-start
+context-all.c:9:17: warning: context imbalance in 'many' - unexpected unlock
+context-all.c:16:9: warning: context imbalance in 'many' - wrong count at exit
+context-all.c:15:9: warning: context imbalance in 'many' - different lock contexts for basic block
+context-all.c:28:9: warning: context imbalance in 'deep' - wrong count at exit
+ * check-error-end
+ */
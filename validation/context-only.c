@@ -0,0 +1,41 @@
+static inline void lock(void) __attribute__((context(0,1)))
+{
+	__context__(1);
+}
+
+static void unlock(void) __attribute__((context(1,0)))
+{
+	__context__(-1);
+}
+
+static void warn_inlined(void)
+{
+	lock();
+}
+
+static void warn_unlock(void)
+{
+	unlock();
+}
+
+static void unlocked(void) __attribute__((context(0,1)))
+{
+}
+
+static int out_of_bounds(void)
+{
+	int a[2] = { 0, 1 };
+
+	return a[2];
+}
+
+/*
+ * check-name: only the functions with contexts are linearized
+ * check-command: sparse -Wno-linearize -Wno-memcpy-max-count $file
+ *
+ * check-error-start
+context-only.c:11:13: warning: context imbalance in 'warn_inlined' - wrong count at exit
+context-only.c:16:13: warning: context imbalance in 'warn_unlock' - unexpected unlock
+context-only.c:21:13: warning: context imbalance in 'unlocked' - wrong count at exit
+ * check-error-end
+ */
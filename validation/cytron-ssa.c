@@ -0,0 +1,88 @@
+int sum(int n, int c);
+int sum(int n, int c)
+{
+	int i, s = 0, t;
+
+	for (i = 0; i < n; i++) {
+		if (c)
+			s += i;
+		else
+			s -= 1;
+		t = s;
+	}
+	while (n--) {
+		if (t)
+			break;
+		t = n;
+	}
+	return s + t;
+}
+
+/*
+ * The phi-nodes for s and i go in the loop header and the one for s
+ * where the branches of the if join, those for n and t in the header
+ * of the while loop: nowhere else.
+ *
+ * check-name: phi-nodes on the dominance frontiers
+ * check-command: test-linearize -fcytron-ssa $file
+ *
+ * check-output-start
+sum:
+.L1:
+	<entry-point>
+	phisrc.32   %phi6(s) <- $0
+	phisrc.32   %phi8(i) <- $0
+	br          .L5
+
+.L5:
+	phi.32      %r27(s) <- %phi6(s), %phi7(s)
+	phi.32      %r28(i) <- %phi8(i), %phi9(i)
+	setlt.32    %r3 <- %r28(i), %arg1
+	br          %r3, .L2, .L4
+
+.L2:
+	br          %arg2, .L6, .L7
+
+.L6:
+	add.32      %r8 <- %r27(s), %r28(i)
+	phisrc.32   %phi4(s) <- %r8
+	br          .L8
+
+.L7:
+	add.32      %r12 <- %r27(s), $-1
+	phisrc.32   %phi5(s) <- %r12
+	br          .L8
+
+.L8:
+	phi.32      %r26(s) <- %phi4(s), %phi5(s)
+	add.32      %r16 <- %r28(i), $1
+	phisrc.32   %phi7(s) <- %r26(s)
+	phisrc.32   %phi9(i) <- %r16
+	br          .L5
+
+.L4:
+	phisrc.32   %phi2(n) <- %arg1
+	phisrc.32   %phi10(t) <- %r27(s)
+	br          .L12
+
+.L12:
+	phi.32      %r25(n) <- %phi2(n), %phi3(n)
+	phi.32      %r29(t) <- %phi10(t), %phi11(t)
+	add.32      %r18 <- %r25(n), $-1
+	br          %r25(n), .L9, .L11
+
+.L9:
+	br          %r29(t), .L11, .L10
+
+.L10:
+	phisrc.32   %phi3(n) <- %r18
+	phisrc.32   %phi11(t) <- %r18
+	br          .L12
+
+.L11:
+	add.32      %r23 <- %r27(s), %r29(t)
+	ret.32      %r23
+
+
+ * check-output-end
+ */
@@ -0,0 +1,29 @@
+struct s {
+	int a;
+	unsigned int lo:4, hi:4;
+	char pad[40];
+	int b[4];
+};
+
+int get(int i);
+int get(int i)
+{
+	struct s s = { .a = 1, .lo = 3, .hi = 5, .b = { [3] = 258 } };
+
+	return s.b[i & 3] + s.a;
+}
+
+/*
+ * The labels are made up of addresses, only the data can be checked:
+ * the bitfields share a byte, and the zero runs are folded wherever
+ * they start.
+ *
+ * check-name: bulk initializer data in compile
+ * check-command: compile $file
+ *
+ * check-output-contains: ^[[:space:]]copy\.512[[:space:]]\.L[0-9]*, 
+ * check-output-contains: ^[[:space:]]\.byte[[:space:]]1,0,0,0,83$
+ * check-output-contains: ^[[:space:]]\.zero[[:space:]]55$
+ * check-output-contains: ^[[:space:]]\.byte[[:space:]]2,1$
+ * check-output-contains: ^[[:space:]]\.zero[[:space:]]2$
+ */
@@ -0,0 +1,27 @@
+struct s {
+	int a;
+	unsigned int lo:4, hi:4;
+	char pad[40];
+	int b[4];
+};
+
+int get(int i);
+int get(int i)
+{
+	struct s s = { .a = 1, .lo = 3, .hi = 5, .b = { [3] = 258 } };
+
+	return s.b[i & 3] + s.a;
+}
+
+/*
+ * Same data as in init-bulk-compile.c, behind an address label.
+ *
+ * check-name: bulk initializer data in example
+ * check-command: example $file
+ *
+ * check-output-contains: ^[[:space:]]copy \$64,\.Linit
+ * check-output-contains: ^[[:space:]]\.byte[[:space:]]1,0,0,0,83$
+ * check-output-contains: ^[[:space:]]\.zero[[:space:]]55$
+ * check-output-contains: ^[[:space:]]\.byte[[:space:]]2,1$
+ * check-output-contains: ^[[:space:]]\.zero[[:space:]]2$
+ */
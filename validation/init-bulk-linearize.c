@@ -0,0 +1,36 @@
+struct s {
+	int a;
+	unsigned int lo:4, hi:4;
+	char pad[40];
+	int b[4];
+};
+
+int get(int i);
+int get(int i)
+{
+	struct s s = { .a = 1, .lo = 3, .hi = 5, .b = { [3] = 258 } };
+
+	return s.b[i & 3] + s.a;
+}
+
+/*
+ * check-name: bulk initializer linearized as one init
+ * check-command: test-linearize $file
+ *
+ * check-output-start
+get:
+.L1:
+	<entry-point>
+	init.512    {...} -> 0[s]
+	add.64      %r2 <- s, $48
+	and.32      %r4 <- %arg1, $3
+	scast.64    %r5 <- (32) %r4
+	muls.64     %r6 <- %r5, $4
+	add.64      %r7 <- %r2, %r6
+	load.32     %r8 <- 0[%r7]
+	add.32      %r9 <- %r8, $1
+	ret.32      %r9
+
+
+ * check-output-end
+ */
@@ -0,0 +1,34 @@
+static void lock(void) __attribute__((context(x,0,1)));
+
+static int lookup(int i)
+{
+	int t[32] = { 1, 2, 3, [20] = 4 };
+
+	return t[i & 31];
+}
+
+static void after_init(void)
+{
+	int t[32] = { 1, 2, 3, [20] = 4 };
+
+	t[8] = 0;
+	if (t[8])
+		lock();
+}
+
+static void overwritten(void)
+{
+	int t[32] = { 1, 2, 3, [20] = 4 };
+
+	t[20] = 5;
+	if (t[20] != 5)
+		lock();
+}
+
+static int (*f)(int) = lookup;
+static void (*g)(void) = after_init;
+static void (*h)(void) = overwritten;
+
+/*
+ * check-name: bulk initializer
+ */
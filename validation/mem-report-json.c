@@ -0,0 +1,16 @@
+static int zero(void)
+{
+	return 0;
+}
+
+/*
+ * check-name: memory report in JSON
+ * check-command: sparse -fmem-report=json $file
+ *
+ * check-output-contains: ^{$
+ * check-output-contains: ^  "allocators": \[$
+ * check-output-contains: ^      "name": "symbols",$
+ * check-output-contains: ^      "peak_bytes": [1-9][0-9]*,$
+ * check-output-contains: ^        "linearize": {$
+ * check-output-contains: ^}$
+ */
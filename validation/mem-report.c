@@ -0,0 +1,13 @@
+static int zero(void)
+{
+	return 0;
+}
+
+/*
+ * check-name: memory report
+ * check-command: sparse -fmem-report $file
+ *
+ * check-error-contains: ^symbols: [1-9][0-9]* allocations, [1-9][0-9]* bytes ([1-9][0-9]* total bytes, [1-9][0-9]* peak bytes)$
+ * check-error-contains: ^tokens: [1-9][0-9]* allocations, [1-9][0-9]* bytes ([1-9][0-9]* total bytes, [1-9][0-9]* peak bytes)$
+ * check-error-contains: ^instruction: [1-9][0-9]* allocations,
+ */
@@ -0,0 +1,45 @@
+struct a { int x; };
+struct b { int y; };
+
+static int same(struct a *p, int x)
+{
+	p->x = 40;
+	return x >> p->x;
+}
+
+static int other_type(struct a *p, struct b *q, int x)
+{
+	p->x = 40;
+	q->y = 1;
+	return x >> p->x;
+}
+
+static int restricted(int *restrict p, int *q, int x)
+{
+	*p = 40;
+	*q = 1;
+	return x >> *p;
+}
+
+static int aliased(int *p, int *q, int x)
+{
+	*p = 40;
+	*q = 1;
+	return x >> *p;
+}
+
+static int (*f1)(struct a *, int) = same;
+static int (*f2)(struct a *, struct b *, int) = other_type;
+static int (*f3)(int *, int *, int) = restricted;
+static int (*f4)(int *, int *, int) = aliased;
+
+/*
+ * check-name: loads forwarded past stores that can't alias
+ * check-command: sparse -fstrict-aliasing $file
+ *
+ * check-error-start
+memops-alias.c:7:21: warning: right shift by bigger than source value
+memops-alias.c:14:21: warning: right shift by bigger than source value
+memops-alias.c:21:22: warning: right shift by bigger than source value
+ * check-error-end
+ */
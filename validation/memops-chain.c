@@ -0,0 +1,60 @@
+static int chain(int *p, int *q)
+{
+	int a;
+
+	*p = 5;
+	a = *p;
+	*q = a;
+	return *q;
+}
+
+static int chain_loads(int *p, int *q, int *r)
+{
+	*q = *p;
+	*r = *q;
+	return *r + *p;
+}
+
+static int chain_local(int *p)
+{
+	int a, b;
+
+	a = *p;
+	b = a;
+	*p = b;
+	return *p;
+}
+/*
+ * check-name: loads forwarded to loads that are forwarded too
+ * check-command: test-linearize $file
+ *
+ * check-output-start
+chain:
+.L1:
+	<entry-point>
+	store.32    $5 -> 0[%arg1]
+	store.32    $5 -> 0[%arg2]
+	ret.32      $5
+
+
+chain_loads:
+.L3:
+	<entry-point>
+	load.32     %r10 <- 0[%arg1]
+	store.32    %r10 -> 0[%arg2]
+	store.32    %r10 -> 0[%arg3]
+	load.32     %r18 <- 0[%arg1]
+	add.32      %r19 <- %r10, %r18
+	ret.32      %r19
+
+
+chain_local:
+.L5:
+	<entry-point>
+	load.32     %r22 <- 0[%arg1]
+	store.32    %r22 -> 0[%arg1]
+	ret.32      %r22
+
+
+ * check-output-end
+ */
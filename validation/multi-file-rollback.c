@@ -0,0 +1,17 @@
+static int counter;
+
+int next(void);
+int next(void)
+{
+	return ++counter;
+}
+
+/*
+ * check-name: declarations are kept from one file to the next
+ * check-command: sparse $file $file
+ *
+ * check-error-start
+multi-file-rollback.c:4:5: warning: multiple definitions for function 'next'
+multi-file-rollback.c:4:5:  the previous one is here
+ * check-error-end
+ */
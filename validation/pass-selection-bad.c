@@ -0,0 +1,16 @@
+static int zero(void)
+{
+	return 0;
+}
+
+/*
+ * liveness always runs, it can't be selected.
+ *
+ * check-name: selecting a pass that can't be
+ * check-command: sparse -fpasses=cse,liveness $file
+ * check-exit-value: 1
+ *
+ * check-error-start
+error: bad argument to "-fpasses=": no optional pass 'liveness'
+ * check-error-end
+ */
@@ -0,0 +1,59 @@
+static int count(int n)
+{
+	int i, s = 0;
+
+	for (i = 0; i < n; i++)
+		s += i;
+	return s;
+}
+
+static int (*f)(int) = count;
+
+/*
+ * "none" drops the passes named before it: the locals stay in memory.
+ *
+ * check-name: running only some of the passes
+ * check-command: test-linearize -fpasses=symbols,none $file
+ *
+ * check-output-start
+count:
+.L1:
+	<entry-point>
+	store.32    %arg1 -> 0[n]
+	store.32    $0 -> 0[s]
+	store.32    $0 -> 0[i]
+	br          .L5
+
+.L5:
+	load.32     %r1 <- 0[i]
+	load.32     %r2 <- 0[n]
+	setlt.32    %r3 <- %r1, %r2
+	br          %r3, .L2, .L4
+
+.L2:
+	load.32     %r4 <- 0[i]
+	load.32     %r5 <- 0[s]
+	scast.32    %r6 <- (32) %r5
+	add.32      %r7 <- %r6, %r4
+	scast.32    %r8 <- (32) %r7
+	store.32    %r8 -> 0[s]
+	br          .L3
+
+.L3:
+	load.32     %r9 <- 0[i]
+	add.32      %r10 <- %r9, $1
+	store.32    %r10 -> 0[i]
+	br          .L5
+
+.L4:
+	load.32     %r11 <- 0[s]
+	phisrc.32   %phi1(return) <- %r11
+	br          .L6
+
+.L6:
+	phi.32      %r12 <- %phi1(return)
+	ret.32      %r11
+
+
+ * check-output-end
+ */
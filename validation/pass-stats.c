@@ -0,0 +1,20 @@
+static int count(int n)
+{
+	int i, s = 0;
+
+	for (i = 0; i < n; i++)
+		s += i;
+	return s;
+}
+
+static int (*f)(int) = count;
+
+/*
+ * check-name: per pass statistics
+ * check-command: sparse -fpasses=none,cse -fdump-pass-stats $file
+ *
+ * check-error-contains: ^pass stats for count:$
+ * check-error-contains: ^  pass  *runs  *changed  *usecs  *insns  *bbs$
+ * check-error-contains: ^  cse  *[1-9][0-9]*  *[1-9][0-9]*  *[0-9][0-9]*  *-[1-9][0-9]*  *[-+][0-9][0-9]*$
+ * check-error-contains: ^pass stats for all functions:$
+ */
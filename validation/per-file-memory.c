@@ -0,0 +1,12 @@
+static int counter;
+
+int next(void);
+int next(void)
+{
+	return ++counter;
+}
+
+/*
+ * check-name: -fper-file-memory drops each file's state
+ * check-command: sparse -fper-file-memory $file $file
+ */
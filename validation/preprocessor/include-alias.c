@@ -0,0 +1,12 @@
+#include "include-alias.h"
+#include "../preprocessor/include-alias.h"
+#include "./include-alias.h"
+/*
+ * check-name: #pragma once under other names
+ * check-command: sparse -E $file
+ *
+ * check-output-start
+
+included
+ * check-output-end
+ */
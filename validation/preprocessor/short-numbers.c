@@ -0,0 +1,21 @@
+#define CAT(a, b) a ## b
+#define N 1234567
+#define N 1234567
+#define M 12345678
+#define M 12345678
+CAT(1, 2) CAT(1234, 5678) CAT(., 5) CAT(1e, +) N M
+__LINE__ defined(N)
+#if CAT(1, 0) == 10 && N + 1 == 1234568 && M == 12345678
+ok
+#endif
+/*
+ * check-name: short numbers kept in the token
+ * check-command: sparse -E $file
+ *
+ * check-output-start
+
+12 12345678 .5 1e+ 1234567 12345678
+7 defined(1234567)
+ok
+ * check-output-end
+ */
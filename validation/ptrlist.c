@@ -0,0 +1,16 @@
+/*
+ * test-ptrlist builds its lists itself, this file is only its test case.
+ *
+ * check-name: plain and vector pointer lists
+ * check-command: test-ptrlist
+ *
+ * check-output-start
+vector: 13/13 29/29 58/61
+plain then vector: 29/29 13/13 18/29
+vector then plain: 13/13 29/29 18/61
+part plain then vector: 29/29 11/13
+odd ones inserted: 29/29 28/29 7/13 7/13 12/13
+deleted from 20: 20/29
+sorted: 29/29 13/13 8/29
+ * check-output-end
+ */
@@ -0,0 +1,20 @@
+static int shift(int n, int x)
+{
+	int i, k = 40;
+
+	for (i = 0; i < n; i++) {
+		if (k != 40)
+			k = 2;
+	}
+	return x >> k;
+}
+
+static int (*f)(int, int) = shift;
+
+/*
+ * check-name: constants propagated through phi-nodes
+ *
+ * check-error-start
+sccp.c:9:21: warning: right shift by bigger than source value
+ * check-error-end
+ */
@@ -0,0 +1,47 @@
+static void lock(void) __attribute__((context(x,0,1)));
+static void unlock(void) __attribute__((context(x,1,0)));
+
+#define CASES(x)					\
+	case 0 ... 9: lock(); break;			\
+	case 20: case 22: case 24: case 26:		\
+	case 30 ... 39: break;				\
+	case 40: lock(); break;				\
+	case 50 ... 99: unlock(); break;
+
+static void balanced(void)
+{
+	int x = 33;
+
+	switch (x) {
+	CASES(x)
+	default: lock(); break;
+	}
+}
+
+static void in_range(void)
+{
+	int x = 5;
+
+	switch (x) {
+	CASES(x)
+	}
+}
+
+static void in_gap(void)
+{
+	int x = 23;
+
+	switch (x) {
+	CASES(x)
+	default: unlock(); break;
+	}
+}
+
+/*
+ * check-name: switch on a constant
+ *
+ * check-error-start
+switch-lookup.c:21:13: warning: context imbalance in 'in_range' - wrong count at exit
+switch-lookup.c:30:13: warning: context imbalance in 'in_gap' - unexpected unlock
+ * check-error-end
+ */
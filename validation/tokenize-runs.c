@@ -0,0 +1,14 @@
+/* ** * * a comment closed across a line splice *\
+/
+static int an_identifier_well_over_thirty_two_bytes_long_0123456789;
+// a line comment, spliced \
+static int hidden = ;
+	static int	bad = 1 +;
+
+/*
+ * check-name: bulk scanning in the tokenizer
+ *
+ * check-error-start
+tokenize-runs.c:6:34: error: No right hand side of '+'-expression
+ * check-error-end
+ */